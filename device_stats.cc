@@ -0,0 +1,66 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <algorithm>
+#include "device_stats.hpp"
+
+device_stats_t::device_stats_t(const char *device) {
+    struct stat64 st;
+    check("Error opening device", stat64(device, &st) != 0);
+    dev_t dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+
+    char path[PATH_MAX], disk[PATH_MAX];
+    snprintf(path, sizeof(path), "/sys/dev/block/%u:%u", major(dev), minor(dev));
+    check("Could not find device statistics (is the file on a block device?)",
+          realpath(path, disk) == NULL);
+
+    // Partitions live in the directory of their disk
+    std::string disk_path = disk;
+    if(access((disk_path + "/partition").c_str(), F_OK) == 0)
+        disk_path = disk_path.substr(0, disk_path.rfind('/'));
+
+    name = disk_path.substr(disk_path.rfind('/') + 1);
+    stat_path = disk_path + "/stat";
+}
+
+void device_stats_t::sample(disk_counters_t *counters) {
+    FILE *file = fopen(stat_path.c_str(), "r");
+    check("Could not open device statistics", file == NULL);
+    int res = fscanf(file, "%llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
+                     &counters->reads, &counters->read_merges, &counters->read_sectors, &counters->read_ticks,
+                     &counters->writes, &counters->write_merges, &counters->write_sectors, &counters->write_ticks,
+                     &counters->in_flight, &counters->io_ticks, &counters->time_in_queue);
+    counters->time = get_ticks();
+    fclose(file);
+    check("Could not read device statistics", res != 11);
+}
+
+const char* device_stats_t::get_name() {
+    return name.c_str();
+}
+
+disk_rates_t device_stats_t::compute_rates(const disk_counters_t &from, const disk_counters_t &to) {
+    disk_rates_t rates;
+    double secs = ticks_to_secs(to.time - from.time);
+    double ms = secs * 1000.0;
+    unsigned long long reads = to.reads - from.reads;
+    unsigned long long writes = to.writes - from.writes;
+
+    rates.reads_per_sec = reads / secs;
+    rates.writes_per_sec = writes / secs;
+    rates.read_merges_per_sec = (to.read_merges - from.read_merges) / secs;
+    rates.write_merges_per_sec = (to.write_merges - from.write_merges) / secs;
+    // Sectors are always 512 bytes here, whatever the device uses
+    rates.read_mb_per_sec = (to.read_sectors - from.read_sectors) * 512.0 / 1024 / 1024 / secs;
+    rates.write_mb_per_sec = (to.write_sectors - from.write_sectors) * 512.0 / 1024 / 1024 / secs;
+    rates.avg_queue_size = (to.time_in_queue - from.time_in_queue) / ms;
+    rates.utilization = std::min(100.0, (to.io_ticks - from.io_ticks) / ms * 100.0);
+    rates.read_await_ms = reads == 0 ? 0 : (double)(to.read_ticks - from.read_ticks) / reads;
+    rates.write_await_ms = writes == 0 ? 0 : (double)(to.write_ticks - from.write_ticks) / writes;
+    return rates;
+}
@@ -0,0 +1,42 @@
+#ifndef __DEVICE_STATS_HPP__
+#define __DEVICE_STATS_HPP__
+
+#include <string>
+#include "utils.hpp"
+
+// Counters from /sys/block/<disk>/stat (see Documentation/block/stat)
+struct disk_counters_t {
+    unsigned long long reads, read_merges, read_sectors, read_ticks;
+    unsigned long long writes, write_merges, write_sectors, write_ticks;
+    unsigned long long in_flight, io_ticks, time_in_queue;
+    ticks_t time;
+};
+
+// What the device did between two samples
+struct disk_rates_t {
+    double reads_per_sec, writes_per_sec;
+    double read_merges_per_sec, write_merges_per_sec;
+    double read_mb_per_sec, write_mb_per_sec;
+    double avg_queue_size;
+    double utilization; // percent
+    double read_await_ms, write_await_ms;
+};
+
+// Samples the statistics of the disk backing a device or file. A
+// partition is mapped to its whole disk, a file to the disk of its
+// file system.
+class device_stats_t {
+public:
+    device_stats_t(const char *device);
+
+    void sample(disk_counters_t *counters);
+    const char* get_name();
+
+    static disk_rates_t compute_rates(const disk_counters_t &from, const disk_counters_t &to);
+
+private:
+    std::string name;
+    std::string stat_path;
+};
+
+#endif // __DEVICE_STATS_HPP__
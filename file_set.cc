@@ -0,0 +1,195 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glob.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "file_set.hpp"
+
+int is_file_set(const char *spec) {
+    if(spec[0] == '@' || strpbrk(spec, "*?[") != NULL)
+        return 1;
+    struct stat64 st;
+    return stat64(spec, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void expand_file_set(const char *spec, std::vector<std::string> *paths) {
+    if(spec[0] == '@') {
+        FILE *file = fopen(spec + 1, "r");
+        check("Could not open the file list", file == NULL);
+        char line[4096];
+        while(fgets(line, sizeof(line), file)) {
+            line[strcspn(line, "\r\n")] = 0;
+            if(line[0] != 0)
+                paths->push_back(line);
+        }
+        fclose(file);
+    } else if(strpbrk(spec, "*?[") != NULL) {
+        glob_t matches;
+        int res = glob(spec, 0, NULL, &matches);
+        check("Could not expand the file set glob", res != 0 && res != GLOB_NOMATCH);
+        for(int i = 0; res == 0 && i < matches.gl_pathc; i++)
+            paths->push_back(matches.gl_pathv[i]);
+        globfree(&matches);
+    } else {
+        DIR *dir = opendir(spec);
+        check("Could not open the file set directory", dir == NULL);
+        dirent *entry;
+        while((entry = readdir(dir)) != NULL) {
+            if(entry->d_name[0] != '.')
+                paths->push_back(std::string(spec) + "/" + entry->d_name);
+        }
+        closedir(dir);
+        std::sort(paths->begin(), paths->end());
+    }
+
+    // Only regular files take part
+    int kept = 0;
+    for(int i = 0; i < paths->size(); i++) {
+        struct stat64 st;
+        if(stat64((*paths)[i].c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            (*paths)[kept++] = (*paths)[i];
+    }
+    paths->resize(kept);
+    check("The file set has no regular files", paths->empty());
+}
+
+off64_t get_file_set_length(const char *spec) {
+    std::vector<std::string> paths;
+    expand_file_set(spec, &paths);
+    off64_t length = 0;
+    for(int i = 0; i < paths.size(); i++)
+        length = std::max(length, get_device_length(paths[i].c_str()));
+    return length;
+}
+
+void drop_file_set_caches(const char *spec) {
+    std::vector<std::string> paths;
+    expand_file_set(spec, &paths);
+    for(int i = 0; i < paths.size(); i++)
+        drop_caches(paths[i].c_str());
+}
+
+/**
+ * File set
+ **/
+file_set_t::file_set_t(workload_config_t *config) {
+    std::vector<std::string> paths;
+    expand_file_set(config->device, &paths);
+    for(int i = 0; i < paths.size(); i++) {
+        file_entry_t file;
+        file.path = paths[i];
+        file.offset = config->offset;
+        file.length = std::min(config->offset + config->length,
+                               get_device_length(paths[i].c_str())) - config->offset;
+        file.length = file.length / config->stride * config->stride;
+        file.cursor = 0;
+        // Files too small for the range stay out of the set
+        if(file.length >= config->block_size)
+            files.push_back(file);
+    }
+    check("No file of the set has room for a block in the range", files.empty());
+}
+
+int file_set_t::size() {
+    return files.size();
+}
+
+file_entry_t* file_set_t::get(int file) {
+    return &files[file];
+}
+
+/**
+ * File pool
+ **/
+file_pool_t::file_pool_t(file_set_t *_files, workload_config_t *_config, int _flags, int thread_id)
+    : opens(0), files(_files), config(_config), flags(_flags), owns_fds(1), next_choice(0),
+      fds(_files->size(), -1), lru_positions(_files->size())
+{
+    init_choices(thread_id);
+    if(config->fd_cache != 0)
+        return;
+    // Pools of other threads may share these fds
+    for(int i = 0; i < files->size(); i++) {
+        if(!config->local_fd || std::binary_search(choices.begin(), choices.end(), i))
+            get_fd(i);
+    }
+}
+
+file_pool_t::file_pool_t(file_pool_t *pool, int thread_id)
+    : opens(0), files(pool->files), config(pool->config), flags(pool->flags), owns_fds(0),
+      next_choice(0), fds(pool->fds)
+{
+    init_choices(thread_id);
+}
+
+file_pool_t::~file_pool_t() {
+    if(!owns_fds)
+        return;
+    for(int i = 0; i < fds.size(); i++) {
+        if(fds[i] != -1)
+            check("Could not close the file", close(fds[i]) == -1);
+    }
+}
+
+void file_pool_t::init_choices(int thread_id) {
+    for(int i = 0; i < files->size(); i++) {
+        if(!config->files_per_thread || i % config->threads == thread_id)
+            choices.push_back(i);
+    }
+    check("Not enough files for a file per thread", choices.empty());
+
+    if(config->file_select != fsl_zipf)
+        return;
+    double sum = 0;
+    for(int i = 0; i < choices.size(); i++) {
+        sum += 1 / pow(i + 1, config->zipf_exponent);
+        zipf_cdf.push_back(sum);
+    }
+    for(int i = 0; i < zipf_cdf.size(); i++)
+        zipf_cdf[i] /= sum;
+}
+
+file_entry_t* file_pool_t::select(long long ops, rnd_gen_t rnd_gen, int *fd) {
+    int choice = 0;
+    if(config->file_select == fsl_uniform) {
+        choice = get_random(rnd_gen, rdt_uniform, choices.size(), 0);
+    } else if(config->file_select == fsl_zipf) {
+        double fraction = get_random_fraction(rnd_gen);
+        choice = std::lower_bound(zipf_cdf.begin(), zipf_cdf.end(), fraction) - zipf_cdf.begin();
+    } else {
+        // Shared files go round in the order of the ops of all threads
+        choice = (config->files_per_thread ? next_choice++ : ops) % choices.size();
+    }
+    choice = std::min(choice, (int)choices.size() - 1);
+    *fd = get_fd(choices[choice]);
+    return files->get(choices[choice]);
+}
+
+int file_pool_t::get_fd(int file) {
+    if(fds[file] != -1) {
+        if(config->fd_cache != 0)
+            lru.splice(lru.begin(), lru, lru_positions[file]);
+        return fds[file];
+    }
+
+    if(config->fd_cache != 0 && lru.size() == config->fd_cache) {
+        int victim = lru.back();
+        lru.pop_back();
+        check("Could not close the file", close(fds[victim]) == -1);
+        fds[victim] = -1;
+    }
+    fds[file] = open64(files->get(file)->path.c_str(), flags);
+    check("Error opening a file of the set (past the open files limit? try --fd-cache)", fds[file] == -1);
+    opens++;
+    if(config->fd_cache != 0) {
+        lru.push_front(file);
+        lru_positions[file] = lru.begin();
+    }
+    return fds[file];
+}
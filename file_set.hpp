@@ -0,0 +1,75 @@
+#ifndef __FILE_SET_HPP__
+#define __FILE_SET_HPP__
+
+#include <list>
+#include <string>
+#include <vector>
+#include "opts.hpp"
+#include "utils.hpp"
+
+// A file of a file set and the range ops fall into, the workload range
+// clipped to the size of the file
+struct file_entry_t {
+    std::string path;
+    off64_t offset;
+    off64_t length;
+    // Sequential ops done on the file, shared by the threads
+    long long cursor;
+};
+
+// Whether DEVICE names a file set: a directory, a glob or @ followed by
+// a file listing one path per line
+int is_file_set(const char *spec);
+// Size of the largest file of the set
+off64_t get_file_set_length(const char *spec);
+void drop_file_set_caches(const char *spec);
+
+// The files of a workload, shared by its threads
+class file_set_t {
+public:
+    file_set_t(workload_config_t *config);
+
+    int size();
+    file_entry_t* get(int file);
+
+private:
+    std::vector<file_entry_t> files;
+};
+
+// The files a thread picks from and the fds it has open. Without a
+// capacity every file is opened up front and stays open, otherwise the
+// least recently used file is closed to make room for the next one.
+class file_pool_t {
+public:
+    file_pool_t(file_set_t *_files, workload_config_t *_config, int _flags, int thread_id);
+    // Shares the fds of another pool, which must keep every file open
+    file_pool_t(file_pool_t *pool, int thread_id);
+    ~file_pool_t();
+
+    // Picks the file of an op, and returns it with its fd
+    file_entry_t* select(long long ops, rnd_gen_t rnd_gen, int *fd);
+
+    // Files opened, including the first open of every file
+    long opens;
+
+private:
+    void init_choices(int thread_id);
+    int get_fd(int file);
+
+    file_set_t *files;
+    workload_config_t *config;
+    int flags;
+    int owns_fds;
+
+    // Indices of the files this thread picks from, with the cumulative
+    // zipf weights of their ranks
+    std::vector<int> choices;
+    std::vector<double> zipf_cdf;
+    long long next_choice;
+
+    std::vector<int> fds; // -1 if closed
+    std::list<int> lru; // open files, most recently used first
+    std::vector<std::list<int>::iterator> lru_positions;
+};
+
+#endif // __FILE_SET_HPP__
@@ -0,0 +1,66 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "histogram_file.hpp"
+
+struct histogram_record_header_t {
+    uint8_t type;
+    uint64_t time;
+    uint32_t length;
+} __attribute__((packed));
+
+int open_histogram_file(const char *file_name) {
+    int fd = open(file_name, O_CREAT | O_TRUNC | O_APPEND | O_WRONLY, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+    check("Error opening the histogram file", fd == -1);
+    int res = write(fd, HISTOGRAM_MAGIC, strlen(HISTOGRAM_MAGIC));
+    check("Could not write the histogram header", res != strlen(HISTOGRAM_MAGIC));
+    return fd;
+}
+
+void write_histogram_record(int fd, histogram_record_t type, ticks_t time,
+                            std::vector<unsigned char> &histogram) {
+    // Write the header and the payload in one go so that records stay
+    // whole even if the run is interrupted
+    std::vector<unsigned char> record(sizeof(histogram_record_header_t));
+    histogram_record_header_t *header = (histogram_record_header_t*)&record[0];
+    header->type = type;
+    header->time = time;
+    header->length = histogram.size();
+    record.insert(record.end(), histogram.begin(), histogram.end());
+
+    int res = write(fd, &record[0], record.size());
+    check("Could not record histogram data", res != record.size());
+}
+
+int merge_histogram_file(const char *file_name, histogram_record_t type, stream_stat_t *stream_stat) {
+    FILE *file = fopen(file_name, "r");
+    check("Error opening the histogram file", file == NULL);
+
+    char magic[sizeof(HISTOGRAM_MAGIC)];
+    int magic_length = strlen(HISTOGRAM_MAGIC);
+    check("Not a rebench histogram file",
+          fread(magic, 1, magic_length, file) != magic_length ||
+          memcmp(magic, HISTOGRAM_MAGIC, magic_length) != 0);
+
+    int merged = 0;
+    histogram_record_header_t header;
+    std::vector<unsigned char> payload;
+    while(fread(&header, sizeof(header), 1, file) == 1) {
+        payload.resize(header.length);
+        if(header.length > 0 && fread(&payload[0], 1, header.length, file) != header.length)
+            break; // truncated record at the end of an interrupted run
+        if(header.type != type)
+            continue;
+        check("Histogram layout doesn't match",
+              stream_stat->merge_into_global(&payload[0], payload.size()) == -1);
+        merged++;
+    }
+
+    fclose(file);
+    return merged;
+}
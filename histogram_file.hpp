@@ -0,0 +1,25 @@
+#ifndef __HISTOGRAM_FILE_HPP__
+#define __HISTOGRAM_FILE_HPP__
+
+#include "utils.hpp"
+#include "stream_stat.hpp"
+
+#define HISTOGRAM_MAGIC "RBHIST02"
+
+// Histogram files hold a sequence of records, one per sample step and
+// one for the whole run. Each record is a type byte, the time in ticks,
+// the payload length and a serialized stream_stat_t histogram.
+enum histogram_record_t {
+    hrt_interval = 1,
+    hrt_total = 2
+};
+
+int open_histogram_file(const char *file_name);
+void write_histogram_record(int fd, histogram_record_t type, ticks_t time,
+                            std::vector<unsigned char> &histogram);
+
+// Merges the records of the given type into the global stat. Returns
+// the number of records merged.
+int merge_histogram_file(const char *file_name, histogram_record_t type, stream_stat_t *stream_stat);
+
+#endif // __HISTOGRAM_FILE_HPP__
@@ -1,20 +1,26 @@
 
 #include <aio.h>
+#include <string.h>
 #include <strings.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <algorithm>
 #include "utils.hpp"
 #include "io_engine.hpp"
 #include "workload.hpp"
 #include "stream_stat.hpp"
 
 int io_engine_t::contribute_open_flags() {
-    if(config->operation == op_read)
+    // Patterns read and write
+    if(config->pattern != pat_none)
+        return O_RDWR;
+    else if(config->operation == op_read)
         return O_RDONLY;
     else if(config->operation == op_write)
         return O_WRONLY;
@@ -43,8 +49,12 @@ void io_engine_t::run_benchmark() {
     rnd_gen = init_rnd_gen();
     check("Error initializing random numbers", rnd_gen == NULL);
 
+    wait_for_start(buf, config->block_size);
+
     char sum = 0;
     while(!(*is_done)) {
+        if(!throttle())
+            break;
         long long _ops = __sync_fetch_and_add(&ops, 1);
         
         // Time calcs
@@ -52,7 +62,9 @@ void io_engine_t::run_benchmark() {
         time_start = get_ticks();
 
         // Perform the op
+        in_flight = 1;
         res = perform_op(buf, _ops, rnd_gen);
+        in_flight = 0;
 
         // Time calcs
         time_end = get_ticks();
@@ -62,6 +74,13 @@ void io_engine_t::run_benchmark() {
             *is_done = 1;
             goto done;
         }
+        // The steps of a pattern are traced one by one
+        if(config->pattern == pat_none)
+            trace_op(time_start, time_end, last_offset, last_operation, last_size);
+        record_op_time(time_start, time_end);
+        // Full batches are flushed outside of the op's timing, the
+        // flushes have their own latency stats
+        flush_full_batches();
         // Read from the buffer to make sure there is no optimization
         // shenanigans
 	sum += buf[0];
@@ -72,13 +91,15 @@ void io_engine_t::run_benchmark() {
     }
 
 done:
+    if(config->operation == op_trim)
+        flush_trims();
     free_rnd_gen(rnd_gen);
     free(buf);
 }
 
 int io_engine_t::perform_op(char *buf, long long ops, rnd_gen_t rnd_gen) {
     off64_t res;
-    off64_t offset = prepare_offset(ops, rnd_gen, config);
+    off64_t offset = next_offset(ops, rnd_gen);
     if(::is_done(offset, config)) {
         return 0;
     }
@@ -94,7 +115,12 @@ int io_engine_t::perform_op(char *buf, long long ops, rnd_gen_t rnd_gen) {
     }
     
     // Perform the operation
-    if(config->operation == op_read)
+    last_offset = offset;
+    last_operation = config->operation;
+    last_size = config->block_size;
+    if(config->pattern != pat_none)
+        perform_sequence(offset, buf);
+    else if(config->operation == op_read)
         perform_read_op(offset, buf);
     else if(config->operation == op_write)
         perform_write_op(offset, buf);
@@ -105,11 +131,129 @@ int io_engine_t::perform_op(char *buf, long long ops, rnd_gen_t rnd_gen) {
 }
 
 void io_engine_t::perform_trim_op(off64_t offset) {
-    check("Trim isn't implemented for this IO interface type (try the stateful IO interface)", 1);
+    if(config->trim_batch == 0) {
+        issue_trim(offset, config->block_size);
+        return;
+    }
+
+    // Flushed by run_benchmark once the batch is full
+    pending_trims.push_back(std::make_pair(offset, offset + config->block_size));
+    pending_trim_bytes += config->block_size;
+}
+
+void io_engine_t::perform_sync_op() {
+    if(config->do_atime)
+        check("Error syncing data", fsync(fd) == -1);
+    else
+        check("Error syncing data", fdatasync(fd) == -1);
+}
+
+void io_engine_t::perform_sequence(off64_t offset, char *buf) {
+    pattern_step_t steps[MAX_PATTERN_STEPS];
+    int count = get_pattern_steps(config->pattern, steps);
+    for(int i = 0; i < count; i++) {
+        off64_t step_offset = steps[i] == pst_journal ? next_journal_offset() : offset;
+        ticks_t time_start = get_ticks();
+        if(steps[i] == pst_read)
+            perform_read_op(step_offset, buf);
+        else if(steps[i] == pst_write || steps[i] == pst_journal)
+            perform_write_op(step_offset, buf);
+        else
+            perform_sync_op();
+        ticks_t time_end = get_ticks();
+        push_step_latency(steps[i], time_end - time_start);
+        trace_step(steps[i], time_start, time_end, step_offset);
+    }
+}
+
+int io_engine_t::complete_step(sequence_t *sequence, ticks_t latency) {
+    pattern_step_t steps[MAX_PATTERN_STEPS];
+    int count = get_pattern_steps(config->pattern, steps);
+    push_step_latency(steps[sequence->step], latency);
+    return ++sequence->step < count;
+}
+
+pattern_step_t io_engine_t::current_step(sequence_t *sequence) {
+    pattern_step_t steps[MAX_PATTERN_STEPS];
+    get_pattern_steps(config->pattern, steps);
+    return steps[sequence->step];
+}
+
+off64_t io_engine_t::next_journal_offset() {
+    return config->journal_offset + (journal_writes++ % JOURNAL_BLOCKS) * config->block_size;
+}
+
+void io_engine_t::flush_trims() {
+    if(pending_trims.empty())
+        return;
+
+    std::sort(pending_trims.begin(), pending_trims.end());
+    off64_t start = pending_trims[0].first, end = pending_trims[0].second;
+    for(int i = 1; i < pending_trims.size(); i++) {
+        if(pending_trims[i].first <= end) {
+            end = std::max(end, pending_trims[i].second);
+        } else {
+            ticks_t time_start = get_ticks();
+            issue_trim(start, end - start);
+            push_flush_latency(get_ticks() - time_start);
+            start = pending_trims[i].first;
+            end = pending_trims[i].second;
+        }
+    }
+    ticks_t time_start = get_ticks();
+    issue_trim(start, end - start);
+    push_flush_latency(get_ticks() - time_start);
+
+    pending_trims.clear();
+    pending_trim_bytes = 0;
+}
+
+void io_engine_t::flush_full_batches() {
+    if(config->trim_batch != 0 && pending_trim_bytes >= config->trim_batch)
+        flush_trims();
+}
+
+void io_engine_t::issue_trim(off64_t offset, off64_t length) {
+#ifndef BLKDISCARD
+#define BLKDISCARD	_IO(0x12,119)
+#endif
+#ifndef BLKSECDISCARD
+#define BLKSECDISCARD	_IO(0x12,125)
+#endif
+#ifndef BLKZEROOUT
+#define BLKZEROOUT	_IO(0x12,127)
+#endif
+
+    int ret = -1;
+    if(config->trim_mode == trm_discard ||
+       config->trim_mode == trm_secure_discard ||
+       config->trim_mode == trm_zero_out)
+    {
+        // The range is given as offset and length
+        __uint64_t range[2];
+        range[0] = offset;
+        range[1] = length;
+        if(config->trim_mode == trm_discard)
+            ret = ioctl(fd, BLKDISCARD, &range);
+        else if(config->trim_mode == trm_secure_discard)
+            ret = ioctl(fd, BLKSECDISCARD, &range);
+        else
+            ret = ioctl(fd, BLKZEROOUT, &range);
+    } else if(config->trim_mode == trm_punch_hole) {
+        ret = fallocate64(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length);
+    } else if(config->trim_mode == trm_zero_range) {
+        ret = fallocate64(fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE, offset, length);
+    } else {
+        check("Invalid trim mode", 1);
+    }
+    check("Issuing trim command failed", ret != 0);
+    trim_commands++;
 }
 
 void io_engine_t::copy_io_state(io_engine_t *io_engine) {
     fd = io_engine->fd;
+    if(io_engine->file_pool)
+        file_pool = new file_pool_t(io_engine->file_pool, thread_id);
 }
 
 void io_engine_t::push_latency(ticks_t latency) {
@@ -117,16 +261,107 @@ void io_engine_t::push_latency(ticks_t latency) {
     res = pthread_mutex_lock(latency_mutex);
     check("Could not lock latency mutex", res != 0);
     if(config->sample_step == 0) {	
-        latencies->push_back(latency);	
+        latencies->add(latency);
     }
     stream_stat->add(latency);
     res = pthread_mutex_unlock(latency_mutex);
     check("Could not unlock latency mutex", res != 0);
 }
 
+void io_engine_t::push_flush_latency(ticks_t latency) {
+    int res = 0;
+    res = pthread_mutex_lock(latency_mutex);
+    check("Could not lock latency mutex", res != 0);
+    flush_stat->add(latency);
+    res = pthread_mutex_unlock(latency_mutex);
+    check("Could not unlock latency mutex", res != 0);
+}
+
+void io_engine_t::push_step_latency(pattern_step_t step, ticks_t latency) {
+    if(step_stats == NULL)
+        return;
+    int res = pthread_mutex_lock(latency_mutex);
+    check("Could not lock latency mutex", res != 0);
+    step_stats[step]->add(latency);
+    res = pthread_mutex_unlock(latency_mutex);
+    check("Could not unlock latency mutex", res != 0);
+}
+
+void io_engine_t::trace_op(ticks_t time_start, ticks_t time_end, off64_t offset, int operation, off64_t size) {
+    if(trace_ring == NULL)
+        return;
+    trace_record_t record;
+    record.start = time_start;
+    record.end = time_end;
+    record.offset = offset;
+    record.size = size;
+    record.operation = operation;
+    record.thread = thread_id;
+    trace_ring->push(record);
+}
+
+void io_engine_t::trace_step(pattern_step_t step, ticks_t time_start, ticks_t time_end, off64_t offset) {
+    if(step == pst_sync)
+        trace_op(time_start, time_end, 0, tro_sync, 0);
+    else
+        trace_op(time_start, time_end, offset, step == pst_read ? op_read : op_write, config->block_size);
+}
+
+void io_engine_t::record_op_time(ticks_t time_start, ticks_t time_end) {
+    if(first_op_start == 0 || time_start < first_op_start)
+        first_op_start = time_start;
+    if(time_end > last_op_end)
+        last_op_end = time_end;
+}
+
+void io_engine_t::wait_for_start(char *buf, int size) {
+    // Fault the buffer in now rather than on the first ops
+    memset(buf, 0, size);
+    if(start_barrier == NULL)
+        return;
+    int res = pthread_barrier_wait(start_barrier);
+    check("Could not wait for the other threads", res != 0 && res != PTHREAD_BARRIER_SERIAL_THREAD);
+}
+
+off64_t io_engine_t::next_offset(long long ops, rnd_gen_t rnd_gen) {
+    if(file_pool == NULL)
+        return prepare_offset(ops, rnd_gen, config);
+    file_entry_t *file = file_pool->select(ops, rnd_gen, &fd);
+    return prepare_offset(ops, rnd_gen, config, file);
+}
+
+int io_engine_t::throttle() {
+    if(phase == NULL)
+        return 1;
+    while(!(*is_done)) {
+        int current = *phase;
+        int rate = config->phases[current].rate;
+        if(current != throttle_phase) {
+            // Start the schedule of a new phase from now
+            throttle_phase = current;
+            next_op_time = get_ticks();
+        }
+        if(rate == 0)
+            return 1;
+        if(rate == PHASE_IDLE) {
+            usleep(1000);
+            continue;
+        }
+        // Every thread takes its share of the workload's rate
+        ticks_t now = get_ticks();
+        if(now >= next_op_time) {
+            next_op_time += 1000000000ULL * config->threads / rate;
+            return 1;
+        }
+        // Wake up at least every millisecond to notice phase changes
+        usleep(std::min((ticks_t)1000, (next_op_time - now) / 1000 + 1));
+    }
+    return 0;
+}
+
 #include "io_engines.hpp"
 
-io_engine_t* make_engine(io_type_t engine_type, std::vector<ticks_t> *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex) {
+io_engine_t* make_engine(io_type_t engine_type, latency_buffer_t *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex) {
     switch(engine_type) {
     case iot_stateful:
         return new io_engine_stateful_t(_latencies, _stream_stat, _latency_mutex);
@@ -143,6 +378,24 @@ io_engine_t* make_engine(io_type_t engine_type, std::vector<ticks_t> *_latencies
     case iot_mmap:
         return new io_engine_mmap_t(_latencies, _stream_stat, _latency_mutex);
         break;
+    case iot_sendfile:
+        return new io_engine_sendfile_t(_latencies, _stream_stat, _latency_mutex);
+        break;
+    case iot_splice:
+        return new io_engine_splice_t(_latencies, _stream_stat, _latency_mutex);
+        break;
+    case iot_copy_range:
+        return new io_engine_copy_range_t(_latencies, _stream_stat, _latency_mutex);
+        break;
+    case iot_null:
+        return new io_engine_null_t(_latencies, _stream_stat, _latency_mutex);
+        break;
+    case iot_meta:
+        return new io_engine_meta_t(_latencies, _stream_stat, _latency_mutex);
+        break;
+    case iot_object:
+        return new io_engine_object_t(_latencies, _stream_stat, _latency_mutex);
+        break;
     default:
         check("Unknown engine type", 1);
     }
@@ -5,15 +5,38 @@
 #include "simulation.hpp"
 #include "utils.hpp"
 #include "stream_stat.hpp"
+#include "trace.hpp"
+#include "latency_buffer.hpp"
+#include "perf_counters.hpp"
+#include "file_set.hpp"
 
 #define DEFAULT_MIN_OP_TIME_IN_MS 1000000.0f
 
+// An op of a pattern in flight on a slot of an async engine
+struct sequence_t {
+    off64_t offset;
+    int step; // index of the step in flight
+    ticks_t start;
+};
+
 class io_engine_t {
 public:
-    io_engine_t(std::vector<ticks_t> *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
-        : config(NULL), fd(0), is_done(NULL), ops(0),
-          latencies(_latencies), stream_stat(_stream_stat), latency_mutex(_latency_mutex)
-        {}
+    io_engine_t(latency_buffer_t *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
+        : config(NULL), fd(0), is_done(NULL), ops(0), in_flight(0), major_faults(0), minor_faults(0),
+          user_usecs(0), system_usecs(0), voluntary_switches(0), involuntary_switches(0),
+          perf_user_only(0),
+          trim_commands(0), trace_ring(NULL), thread_id(0), start_barrier(NULL),
+          first_op_start(0), last_op_end(0), phase(NULL), file_pool(NULL), file_opens(0),
+          meta_stats(NULL), object_bytes(0), step_stats(NULL),
+          last_offset(0), last_operation(0), last_size(0),
+          throttle_phase(-1), next_op_time(0), journal_writes(0), pending_trim_bytes(0),
+          latencies(_latencies), stream_stat(_stream_stat), latency_mutex(_latency_mutex),
+          flush_stat(NULL)
+        {
+            for(int i = 0; i < pfc_count; i++)
+                perf_values[i] = -1;
+        }
+    virtual ~io_engine_t() {}
     
     virtual int contribute_open_flags();
     virtual void post_open_setup();
@@ -26,24 +49,130 @@ public:
     virtual void perform_read_op(off64_t offset, char *buf) = 0;
     virtual void perform_write_op(off64_t offset, char *buf) = 0;
     virtual void perform_trim_op(off64_t offset);
+    // Syncs the data written so far, a step of patterns
+    virtual void perform_sync_op();
 
     virtual void copy_io_state(io_engine_t *io_engine);
 
 protected:
     void push_latency(ticks_t latency);
+    void push_flush_latency(ticks_t latency);
+    // Records an issued op, operation is an operation_t or a
+    // trace_operation_t
+    void trace_op(ticks_t time_start, ticks_t time_end, off64_t offset, int operation, off64_t size);
+    // Records a step of a pattern sequence
+    void trace_step(pattern_step_t step, ticks_t time_start, ticks_t time_end, off64_t offset);
+    // Extends the window of completed ops
+    void record_op_time(ticks_t time_start, ticks_t time_end);
+
+    // Touches the IO buffer and waits for every other thread to be ready
+    void wait_for_start(char *buf, int size);
+
+    // Runs the steps of an op of the pattern one after the other
+    void perform_sequence(off64_t offset, char *buf);
+    // Records a completed step of a sequence on an async slot, returns 1
+    // if the sequence has steps left
+    int complete_step(sequence_t *sequence, ticks_t latency);
+    pattern_step_t current_step(sequence_t *sequence);
+    // Offset of the next journal write, going round the journal area
+    off64_t next_journal_offset();
+    void push_step_latency(pattern_step_t step, ticks_t latency);
+
+    // Offset of the next op. On a file set, also points fd at the file
+    // of the op.
+    off64_t next_offset(long long ops, rnd_gen_t rnd_gen);
+
+    // Waits until the current phase allows the next op, returns 0 once
+    // the workload is done
+    int throttle();
+
+    void issue_trim(off64_t offset, off64_t length);
+    // Merges the queued trims and issues them
+    void flush_trims();
+    // Flushes whatever batch the last op filled up, called by
+    // run_benchmark outside of the op's timing
+    virtual void flush_full_batches();
     
 public:
     int fd;
     workload_config_t *config;
     int *is_done;
     long ops;
+
+    // Operations submitted and not completed yet, only written by the
+    // thread running the engine
+    int in_flight;
+
+    // Page faults taken by the thread running the engine
+    long major_faults;
+    long minor_faults;
+
+    // CPU time used by the thread running the engine
+    long long user_usecs;
+    long long system_usecs;
+    long voluntary_switches;
+    long involuntary_switches;
+
+    // perf_event_open counts, -1 where unavailable
+    long long perf_values[pfc_count];
+    int perf_user_only;
+
+    // Trim commands actually issued, after batching
+    long trim_commands;
     
-    std::vector<ticks_t> *latencies;
+    latency_buffer_t *latencies;
     stream_stat_t *stream_stat;
     pthread_mutex_t *latency_mutex;
+
+    // Latencies of flushes issued separately from the op itself
+    stream_stat_t *flush_stat;
+
+    // Per thread trace ring, NULL unless tracing
+    trace_ring_t *trace_ring;
+    int thread_id;
+
+    // Shared by the threads of all workloads, NULL to start right away
+    pthread_barrier_t *start_barrier;
+
+    // Start of the first and end of the last completed op, 0 if none
+    ticks_t first_op_start;
+    ticks_t last_op_end;
+
+    // Index of the current phase, set by the monitor. NULL without phases.
+    volatile int *phase;
+
+    // The files of the thread, NULL unless the workload runs on a file set
+    file_pool_t *file_pool;
+    // Files the thread opened, counted when the pool is closed
+    long file_opens;
+
+    // Latencies of every metadata op, NULL unless the engine is 'meta'
+    stream_stat_t **meta_stats;
+    // Bytes the ops of an 'object' engine read or wrote, the other engines
+    // move a block per op
+    long long object_bytes;
+
+    // Latencies of every kind of pattern step, NULL without a pattern
+    stream_stat_t **step_stats;
+
+protected:
+    // Offset, operation and size of the last op performed by perform_op
+    off64_t last_offset;
+    int last_operation;
+    off64_t last_size;
+
+    // Rate schedule of the phase the thread last saw
+    int throttle_phase;
+    ticks_t next_op_time;
+
+    long long journal_writes;
+
+private:
+    std::vector<std::pair<off64_t, off64_t> > pending_trims;
+    off64_t pending_trim_bytes;
 };
 
-io_engine_t* make_engine(io_type_t engine_type, std::vector<ticks_t> *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex);
+io_engine_t* make_engine(io_type_t engine_type, latency_buffer_t *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex);
 
 #endif // __IO_ENGINE_HPP__
 
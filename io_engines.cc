@@ -8,10 +8,13 @@
 #include <sys/stat.h>
 #include <sys/eventfd.h>
 #include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
 #include <stdio.h>
 #include "io_engines.hpp"
 #include "workload.hpp"
@@ -41,7 +44,8 @@ void io_engine_stateful_t::perform_write_op(off64_t offset, char *buf) {
     res = write(fd, buf, config->block_size);
     check("Error writing to device", res == -1 || res != config->block_size);
     
-    if(!config->buffered) {
+    // Patterns sync in steps of their own
+    if(!config->buffered && config->pattern == pat_none) {
         if(config->do_atime)
             check("Error syncing data", fsync(fd) == -1);
         else
@@ -49,18 +53,6 @@ void io_engine_stateful_t::perform_write_op(off64_t offset, char *buf) {
     }
 }
 
-void io_engine_stateful_t::perform_trim_op(off64_t offset) {
-#ifndef BLKDISCARD
-#define BLKDISCARD	_IO(0x12,119)
-#endif
-
-    __uint64_t range[2];
-    range[0] = offset;
-    range[1] = offset + config->block_size;
-    int ret = ioctl(fd, BLKDISCARD, &range);
-    check("Issuing trim command failed", ret != 0);
-}
-
 /**
  * Stateless engine
  **/
@@ -75,7 +67,7 @@ void io_engine_stateless_t::perform_write_op(off64_t offset, char *buf) {
     off64_t res = -1;
     res = pwrite64(fd, buf, config->block_size, offset);
     check("Error writing to device", res == -1 || res != config->block_size);
-    if(!config->buffered) {
+    if(!config->buffered && config->pattern == pat_none) {
         if(config->do_atime)
             check("Error syncing data", fsync(fd) == -1);
         else
@@ -104,7 +96,8 @@ void io_engine_paio_t::perform_write_op(off64_t offset, char *buf) {
     check("Unused - if you see this, it's a bug in rebench", 1);
 }
 int io_engine_paio_t::perform_op(char *buf, long long ops, rnd_gen_t rnd_gen) {
-    check("Unused - if you see this, it's a bug in rebench", 1);
+    // Only used for trims, which are performed synchronously
+    return io_engine_t::perform_op(buf, ops, rnd_gen);
 }
 
 void io_engine_paio_t::perform_read_op(off64_t offset, char *buf, aiocb64 *request) {
@@ -135,6 +128,28 @@ void io_engine_paio_t::perform_write_op(off64_t offset, char *buf, aiocb64 *requ
     check("aio_write failed", res != 0);
 }
 
+void io_engine_paio_t::perform_sync_op(aiocb64 *request) {
+    bzero(request, sizeof(aiocb64));
+    request->aio_fildes = fd;
+    set_timestamp(request);
+
+    int res = aio_fsync64(config->do_atime ? O_SYNC : O_DSYNC, request);
+    check("aio_fsync failed", res != 0);
+}
+
+void io_engine_paio_t::perform_step(char *buf, aiocb64 *request) {
+    sequence_t *sequence = &sequences[request - requests];
+    pattern_step_t step = current_step(sequence);
+    if(step == pst_read)
+        perform_read_op(sequence->offset, buf, request);
+    else if(step == pst_write)
+        perform_write_op(sequence->offset, buf, request);
+    else if(step == pst_journal)
+        perform_write_op(next_journal_offset(), buf, request);
+    else
+        perform_sync_op(request);
+}
+
 void io_engine_paio_t::set_timestamp(aiocb64 *request) {
     ticks_t* timestamp = (ticks_t*)malloc(sizeof(ticks_t) * 1);
     timestamp[0] = get_ticks();
@@ -143,7 +158,7 @@ void io_engine_paio_t::set_timestamp(aiocb64 *request) {
 
 int io_engine_paio_t::perform_op(char *buf, aiocb64 *request, long long ops, rnd_gen_t rnd_gen) {
     off64_t res;
-    off64_t offset = prepare_offset(ops, rnd_gen, config);
+    off64_t offset = next_offset(ops, rnd_gen);
     if(::is_done(offset, config)) {
         return 0;
     }
@@ -159,17 +174,32 @@ int io_engine_paio_t::perform_op(char *buf, aiocb64 *request, long long ops, rnd
     }
     
     // Perform the operation
-    if(config->operation == op_read)
+    if(config->pattern != pat_none) {
+        sequence_t *sequence = &sequences[request - requests];
+        sequence->offset = offset;
+        sequence->step = 0;
+        sequence->start = get_ticks();
+        perform_step(buf, request);
+    } else if(config->operation == op_read) {
         perform_read_op(offset, buf, request);
-    else if(config->operation == op_write)
+    } else if(config->operation == op_write) {
         perform_write_op(offset, buf, request);
+    }
+    in_flight++;
     
     return 1;
 }
 
 void io_engine_paio_t::run_benchmark() {
+    // There is no asynchronous trim, fall back to the synchronous loop
+    if(config->operation == op_trim) {
+        io_engine_t::run_benchmark();
+        return;
+    }
+
     // Create the arrays of requests and buffers
     requests = (aiocb64*)malloc(sizeof(aiocb64) * config->queue_depth);
+    sequences = (sequence_t*)malloc(sizeof(sequence_t) * config->queue_depth);
     
     char *buf;
     int res = posix_memalign((void**)&buf,
@@ -181,16 +211,22 @@ void io_engine_paio_t::run_benchmark() {
     rnd_gen_t rnd_gen;
     rnd_gen = init_rnd_gen();
     check("Error initializing random numbers", rnd_gen == NULL);
+
+    wait_for_start(buf, config->block_size * config->queue_depth);
     
     // Fill up the queue with initial requests
     aiocb64* aio_reqs[config->queue_depth];
+    for(int i = 0; i < config->queue_depth; i++)
+        aio_reqs[i] = NULL;
     for(int i = 0; i < config->queue_depth; i++) {
-        aio_reqs[i] = &requests[i];
+        if(!throttle())
+            goto done;
         long long _ops = __sync_fetch_and_add(&ops, 1);
-        if(!perform_op(buf + config->block_size * i, aio_reqs[i], _ops, rnd_gen)) {
+        if(!perform_op(buf + config->block_size * i, &requests[i], _ops, rnd_gen)) {
             *is_done = 1;
             goto done;
         }
+        aio_reqs[i] = &requests[i];
     }
 
     // Add more requests as we get results, or quit when done
@@ -199,6 +235,8 @@ void io_engine_paio_t::run_benchmark() {
         check("aio_suspend failed", res != 0);
 
         // Look through the requests
+        int completed[config->queue_depth];
+        int completed_count = 0;
         for(int i = 0; i < config->queue_depth; i++) {
             res = aio_error64(aio_reqs[i]);
             if(res > 0)
@@ -210,22 +248,58 @@ void io_engine_paio_t::run_benchmark() {
                 check("Error reading from device", res < -1);
 
                 ticks_t* timestamp = (ticks_t*)(aio_reqs[i]->aio_sigevent.sigev_value.sival_ptr);
-		push_latency(get_ticks() - timestamp[0]);
+                ticks_t time_start = timestamp[0];
+                ticks_t time_end = get_ticks();
+                off64_t offset = aio_reqs[i]->aio_offset;
 	        free(timestamp);                              
-
-                // Submit another request
-                long long _ops = __sync_fetch_and_add(&ops, 1);
-                if(!perform_op(buf + config->block_size * i, aio_reqs[i], _ops, rnd_gen)) {
-                    *is_done = 1;
-                    goto done;
+                if(config->pattern != pat_none) {
+                    // The next step goes right away, the op is timed
+                    // from the start of its first step
+                    trace_step(current_step(&sequences[i]), time_start, time_end, offset);
+                    if(complete_step(&sequences[i], time_end - time_start)) {
+                        perform_step(buf + config->block_size * i, aio_reqs[i]);
+                        continue;
+                    }
+                    time_start = sequences[i].start;
+                    offset = sequences[i].offset;
                 }
+		push_latency(time_end - time_start);
+                if(config->pattern == pat_none)
+                    trace_op(time_start, time_end, offset, config->operation, config->block_size);
+                record_op_time(time_start, time_end);
+                in_flight--;
+                completed[completed_count++] = i;
+            }
+        }
+
+        // Submit another request for each completed one, only once all
+        // of them are timed as throttling may wait
+        for(int j = 0; j < completed_count; j++) {
+            int i = completed[j];
+            if(!throttle())
+                goto done;
+            long long _ops = __sync_fetch_and_add(&ops, 1);
+            if(!perform_op(buf + config->block_size * i, aio_reqs[i], _ops, rnd_gen)) {
+                *is_done = 1;
+                goto done;
             }
         }
     }
 
 done:
+    // Wait for the requests still in flight, they write into buf
+    for(int i = 0; i < config->queue_depth; i++) {
+        if(aio_reqs[i] == NULL || aio_error64(aio_reqs[i]) != EINPROGRESS)
+            continue;
+        while(aio_error64(aio_reqs[i]) == EINPROGRESS)
+            aio_suspend64(&aio_reqs[i], 1, NULL);
+        aio_return64(aio_reqs[i]);
+        free(aio_reqs[i]->aio_sigevent.sigev_value.sival_ptr);
+        in_flight--;
+    }
     free_rnd_gen(rnd_gen);
     free(requests);
+    free(sequences);
     free(buf);
 }
 
@@ -241,10 +315,17 @@ void io_engine_naio_t::perform_write_op(off64_t offset, char *buf) {
 }
 
 int io_engine_naio_t::perform_op(char *buf, long long ops, rnd_gen_t rnd_gen) {
-    check("Unused - if you see this, it's a bug in rebench", 1);
+    // Only used for trims, which are performed synchronously
+    return io_engine_t::perform_op(buf, ops, rnd_gen);
 }
 
 void io_engine_naio_t::run_benchmark() {
+    // There is no asynchronous trim, fall back to the synchronous loop
+    if(config->operation == op_trim) {
+        io_engine_t::run_benchmark();
+        return;
+    }
+
     // Setup context
     memset(&ctx_id, 0, sizeof(io_context_t));
     int res = io_setup(config->queue_depth, &ctx_id);
@@ -274,6 +355,7 @@ void io_engine_naio_t::run_benchmark() {
     
     // Create the arrays of requests and buffers
     requests = (iocb*)malloc(sizeof(iocb) * config->queue_depth);
+    sequences = (sequence_t*)malloc(sizeof(sequence_t) * config->queue_depth);
     
     char *buf;
     res = posix_memalign((void**)&buf,
@@ -285,9 +367,14 @@ void io_engine_naio_t::run_benchmark() {
     rnd_gen_t rnd_gen;
     rnd_gen = init_rnd_gen();
     check("Error initializing random numbers", rnd_gen == NULL);
+
+    wait_for_start(buf, config->block_size * config->queue_depth);
     
     // Fill up the queue with initial requests
+    io_event events[config->queue_depth];
     for(int i = 0; i < config->queue_depth; i++) {
+        if(!throttle())
+            goto done;
         long long _ops = __sync_fetch_and_add(&ops, 1);
         if(!perform_op(buf + config->block_size * i, &requests[i], _ops, rnd_gen)) {
             *is_done = 1;
@@ -296,7 +383,6 @@ void io_engine_naio_t::run_benchmark() {
     }
 
     // Add more requests as we get results, or quit when done
-    io_event events[config->queue_depth];
     while(!(*is_done)) {
         if(config->use_eventfd) {
             epoll_event events[1];
@@ -319,18 +405,46 @@ void io_engine_naio_t::run_benchmark() {
         check("aio_suspend failed", res < 0);
 
         // Look through the requests
+        iocb *completed[config->queue_depth];
+        int completed_count = 0;
         for(int i = 0; i < res; i++) {
             iocb *req = (iocb*)events[i].obj;
             // Check return value
             check("Error reading from device", events[i].res < 0);
 	
             ticks_t* timestamp = (ticks_t*)(events[i].data);
-            push_latency(get_ticks() - timestamp[0]);
+            ticks_t time_start = timestamp[0];
+            ticks_t time_end = get_ticks();
+            off64_t offset = req->u.c.offset;
 	    free(timestamp);
-            
-            // Submit another request
+            if(config->pattern != pat_none) {
+                // The next step goes right away, the op is timed from
+                // the start of its first step
+                sequence_t *sequence = &sequences[req - requests];
+                trace_step(current_step(sequence), time_start, time_end, offset);
+                if(complete_step(sequence, time_end - time_start)) {
+                    perform_step(buf + config->block_size * (req - requests), req);
+                    continue;
+                }
+                time_start = sequence->start;
+                offset = sequence->offset;
+            }
+            push_latency(time_end - time_start);
+            if(config->pattern == pat_none)
+                trace_op(time_start, time_end, offset, config->operation, config->block_size);
+            record_op_time(time_start, time_end);
+            in_flight--;
+            completed[completed_count++] = req;
+        }
+
+        // Submit another request for each completed one, only once all
+        // of them are timed as throttling may wait
+        for(int i = 0; i < completed_count; i++) {
+            iocb *req = completed[i];
+            if(!throttle())
+                goto done;
             long long _ops = __sync_fetch_and_add(&ops, 1);
-            if(!perform_op((char*)req->u.c.buf, req, _ops, rnd_gen)) {
+            if(!perform_op(buf + config->block_size * (req - requests), req, _ops, rnd_gen)) {
                 *is_done = 1;
                 goto done;
             }
@@ -338,8 +452,23 @@ void io_engine_naio_t::run_benchmark() {
     }
 
 done:
+    // Reap the requests still in flight, they write into buf
+    while(in_flight > 0) {
+        res = io_getevents(ctx_id, 1, config->queue_depth, events, NULL);
+        if(res == -EINTR)
+            continue;
+        if(res < 0)
+            errno = -res;
+        check("aio_suspend failed", res < 0);
+        for(int i = 0; i < res; i++) {
+            free(events[i].data);
+            in_flight--;
+        }
+    }
+    io_destroy(ctx_id);
     free_rnd_gen(rnd_gen);
     free(requests);
+    free(sequences);
     free(buf);
     if(config->use_eventfd)
         close(epoll_fd);
@@ -348,18 +477,37 @@ done:
 void io_engine_naio_t::perform_read_op(off64_t offset, char *buf, iocb *request) {
     bzero(request, sizeof(iocb));
     io_prep_pread(request, fd, buf, config->block_size, offset);    
-    set_timestamp(request);
-    if(config->use_eventfd)
-        io_set_eventfd(request, notification_fd);
-    iocb* _requests[1];
-    _requests[0] = request;
-    int res = io_submit(ctx_id, 1, _requests);
-    check("Could not submit IO request", res < 1);
+    submit_request(request);
 }
 
 void io_engine_naio_t::perform_write_op(off64_t offset, char *buf, iocb *request) {
     bzero(request, sizeof(iocb));
     io_prep_pwrite(request, fd, buf, config->block_size, offset);
+    submit_request(request);
+}
+
+void io_engine_naio_t::perform_sync_op(iocb *request) {
+    if(config->do_atime)
+        io_prep_fsync(request, fd);
+    else
+        io_prep_fdsync(request, fd);
+    submit_request(request);
+}
+
+void io_engine_naio_t::perform_step(char *buf, iocb *request) {
+    sequence_t *sequence = &sequences[request - requests];
+    pattern_step_t step = current_step(sequence);
+    if(step == pst_read)
+        perform_read_op(sequence->offset, buf, request);
+    else if(step == pst_write)
+        perform_write_op(sequence->offset, buf, request);
+    else if(step == pst_journal)
+        perform_write_op(next_journal_offset(), buf, request);
+    else
+        perform_sync_op(request);
+}
+
+void io_engine_naio_t::submit_request(iocb *request) {
     set_timestamp(request);
     if(config->use_eventfd)
         io_set_eventfd(request, notification_fd);
@@ -371,7 +519,7 @@ void io_engine_naio_t::perform_write_op(off64_t offset, char *buf, iocb *request
 
 int io_engine_naio_t::perform_op(char *buf, iocb *request, long long ops, rnd_gen_t rnd_gen) {
     off64_t res;
-    off64_t offset = prepare_offset(ops, rnd_gen, config);
+    off64_t offset = next_offset(ops, rnd_gen);
     if(::is_done(offset, config)) {
         return 0;
     }       
@@ -387,10 +535,18 @@ int io_engine_naio_t::perform_op(char *buf, iocb *request, long long ops, rnd_ge
     }
     
     // Perform the operation
-    if(config->operation == op_read)
+    if(config->pattern != pat_none) {
+        sequence_t *sequence = &sequences[request - requests];
+        sequence->offset = offset;
+        sequence->step = 0;
+        sequence->start = get_ticks();
+        perform_step(buf, request);
+    } else if(config->operation == op_read) {
         perform_read_op(offset, buf, request);
-    else if(config->operation == op_write)
+    } else if(config->operation == op_write) {
         perform_write_op(offset, buf, request);
+    }
+    in_flight++;
     
     return 1;
 }
@@ -404,6 +560,11 @@ void io_engine_naio_t::set_timestamp(iocb *request) {
 /**
  * mmap engine
  **/
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
 int io_engine_mmap_t::contribute_open_flags() {
     if(config->operation == op_write)
         return O_RDWR;
@@ -412,35 +573,528 @@ int io_engine_mmap_t::contribute_open_flags() {
 }
 
 void io_engine_mmap_t::post_open_setup() {
+    // With a sliding window every thread maps its own window lazily
+    if(config->mmap_window == 0)
+        map_window(0, config->device_length);
+}
+
+void io_engine_mmap_t::pre_close_teardown() {
+    if(config->mmap_window == 0)
+        unmap_window();
+}
+
+void io_engine_mmap_t::run_benchmark() {
+    io_engine_t::run_benchmark();
+    flush_dirty_range();
+    if(config->mmap_window != 0)
+        unmap_window();
+}
+
+void io_engine_mmap_t::map_window(off64_t offset, off64_t length) {
     int prot = 0;
     if(config->operation == op_read)
         prot = PROT_READ;
     else
         prot = PROT_WRITE | PROT_READ;
-    map = mmap(NULL,
-               config->device_length,
-               prot, MAP_SHARED, fd, 0);
+
+    int flags = MAP_SHARED;
+    if(config->mmap_populate)
+        flags |= MAP_POPULATE;
+
+    void *hint = NULL;
+    if(config->mmap_advice == mad_hugepage) {
+        // The kernel only backs huge page aligned addresses with huge
+        // pages, so reserve a larger range and map at an aligned address
+        // inside of it. The tail of the file may end mid page, the
+        // reservation is trimmed at page granularity.
+        off64_t reserved_length = (length + getpagesize() - 1) / getpagesize() * getpagesize();
+        char *reserved = (char*)mmap(NULL, reserved_length + HUGE_PAGE_SIZE, PROT_NONE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        check("Unable to reserve mapping address", reserved == MAP_FAILED);
+        char *aligned = (char*)(((uintptr_t)reserved + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+        if(aligned > reserved)
+            check("Unable to unmap memory", munmap(reserved, aligned - reserved) != 0);
+        check("Unable to unmap memory",
+              munmap(aligned + reserved_length, reserved + HUGE_PAGE_SIZE - aligned) != 0);
+        hint = aligned;
+        flags |= MAP_FIXED;
+    }
+
+    map = mmap(hint, length, prot, flags, fd, offset);
     check("Unable to mmap memory", map == MAP_FAILED);
+    map_offset = offset;
+    map_length = length;
+
+    int advice = -1;
+    if(config->mmap_advice == mad_random)
+        advice = MADV_RANDOM;
+    else if(config->mmap_advice == mad_sequential)
+        advice = MADV_SEQUENTIAL;
+    else if(config->mmap_advice == mad_willneed)
+        advice = MADV_WILLNEED;
+    else if(config->mmap_advice == mad_hugepage)
+        advice = MADV_HUGEPAGE;
+    if(advice != -1) {
+        check("Unable to madvise mapped memory",
+              madvise(map, map_length, advice) != 0);
+    }
 }
 
-void io_engine_mmap_t::pre_close_teardown() {
+void io_engine_mmap_t::unmap_window() {
+    if(map == NULL)
+        return;
+    flush_dirty_range();
     check("Unable to unmap memory",
-          munmap(map, config->device_length) != 0);
+          munmap(map, map_length) != 0);
+    map = NULL;
+    map_offset = 0;
+    map_length = 0;
+}
+
+char* io_engine_mmap_t::map_address(off64_t offset) {
+    off64_t end = offset + op_length(offset);
+    if(map == NULL || offset < map_offset || end > map_offset + map_length)
+    {
+        // Windows start at a multiple of the window size so that
+        // sequential workloads slide through the device. Huge pages
+        // need the window to be aligned to the huge page size.
+        off64_t alignment = getpagesize();
+        if(config->mmap_advice == mad_hugepage)
+            alignment = HUGE_PAGE_SIZE;
+        off64_t window = (config->mmap_window + alignment - 1) / alignment * alignment;
+        off64_t start = offset / window * window;
+        if(end > start + window)
+            start = offset / alignment * alignment;
+        // A block straddling the aligned boundary still has to fit
+        off64_t length = std::max(window, end - start);
+        length = std::min(length, config->device_length - start);
+
+        unmap_window();
+        map_window(start, length);
+    }
+    return (char*)map + (offset - map_offset);
+}
+
+off64_t io_engine_mmap_t::op_length(off64_t offset) {
+    return std::min((off64_t)config->block_size, config->device_length - offset);
 }
 
 void io_engine_mmap_t::perform_read_op(off64_t offset, char *buf) {
-    memcpy(buf, (char*)map + offset, config->block_size);
+    memcpy(buf, map_address(offset), op_length(offset));
 }
 
 void io_engine_mmap_t::perform_write_op(off64_t offset, char *buf) {
-    memcpy((char*)map + offset, buf, config->block_size);
+    off64_t length = op_length(offset);
+    memcpy(map_address(offset), buf, length);
     if(!config->buffered) {
+        // msync needs a page aligned address, so the pages the write
+        // touched are flushed whole
+        off64_t start = offset / getpagesize() * getpagesize();
+        dirty_ranges.push_back(std::make_pair(start, offset + length));
+        dirty_writes++;
+    }
+}
+
+void io_engine_mmap_t::flush_full_batches() {
+    io_engine_t::flush_full_batches();
+    if(dirty_writes >= config->msync_batch)
+        flush_dirty_range();
+}
+
+void io_engine_mmap_t::flush_dirty_range() {
+    if(dirty_writes == 0)
+        return;
+
+    // Only the written pages are flushed, one msync per run of adjacent
+    // ones
+    std::sort(dirty_ranges.begin(), dirty_ranges.end());
+    int flags = config->msync_async ? MS_ASYNC : MS_SYNC;
+    off64_t start = dirty_ranges[0].first, end = dirty_ranges[0].second;
+    for(int i = 1; i <= dirty_ranges.size(); i++) {
+        if(i < dirty_ranges.size() && dirty_ranges[i].first <= end) {
+            end = std::max(end, dirty_ranges[i].second);
+            continue;
+        }
+        ticks_t time_start = get_ticks();
         check("Could not flush mmapped memory",
-              msync(map, offset + config->block_size, MS_SYNC) != 0);
+              msync((char*)map + (start - map_offset), end - start, flags) != 0);
+        push_flush_latency(get_ticks() - time_start);
+        if(i < dirty_ranges.size()) {
+            start = dirty_ranges[i].first;
+            end = dirty_ranges[i].second;
+        }
     }
+    dirty_ranges.clear();
+    dirty_writes = 0;
 }
 
 void io_engine_mmap_t::copy_io_state(io_engine_t *io_engine) {
     io_engine_t::copy_io_state(io_engine);
-    map = (dynamic_cast<io_engine_mmap_t*>(io_engine))->map;
+    if(config->mmap_window == 0) {
+        io_engine_mmap_t *mmap_engine = dynamic_cast<io_engine_mmap_t*>(io_engine);
+        map = mmap_engine->map;
+        map_offset = mmap_engine->map_offset;
+        map_length = mmap_engine->map_length;
+    }
+}
+
+/**
+ * sendfile engine
+ **/
+void io_engine_sendfile_t::run_benchmark() {
+    sink_fd = open("/dev/null", O_WRONLY);
+    check("Could not open the sink", sink_fd == -1);
+
+    io_engine_t::run_benchmark();
+
+    check("Could not close the sink", close(sink_fd) == -1);
+}
+
+void io_engine_sendfile_t::perform_read_op(off64_t offset, char *buf) {
+    off_t _offset = offset;
+    ssize_t res = sendfile(sink_fd, fd, &_offset, config->block_size);
+    check("Error sending from device", res == -1);
+    check("Attempting to read from the end of the device", res == 0);
+}
+
+void io_engine_sendfile_t::perform_write_op(off64_t offset, char *buf) {
+    check("Unused - if you see this, it's a bug in rebench", 1);
+}
+
+/**
+ * splice engine
+ **/
+void io_engine_splice_t::run_benchmark() {
+    check("Could not create the pipe", pipe(pipe_fds) == -1);
+    // Make sure a whole block fits into the pipe
+    if(config->block_size > getpagesize() * 16) {
+        check("Could not resize the pipe",
+              fcntl(pipe_fds[1], F_SETPIPE_SZ, config->block_size) == -1);
+    }
+    sink_fd = open("/dev/null", O_WRONLY);
+    check("Could not open the sink", sink_fd == -1);
+
+    io_engine_t::run_benchmark();
+
+    check("Could not close the sink", close(sink_fd) == -1);
+    check("Could not close the pipe",
+          close(pipe_fds[0]) == -1 || close(pipe_fds[1]) == -1);
+}
+
+void io_engine_splice_t::perform_read_op(off64_t offset, char *buf) {
+    loff_t _offset = offset;
+    ssize_t in = splice(fd, &_offset, pipe_fds[1], NULL, config->block_size, SPLICE_F_MOVE);
+    check("Error splicing from device", in == -1);
+    check("Attempting to read from the end of the device", in == 0);
+
+    // Drain the pipe into the sink
+    while(in > 0) {
+        ssize_t out = splice(pipe_fds[0], NULL, sink_fd, NULL, in, SPLICE_F_MOVE);
+        check("Error splicing to the sink", out <= 0);
+        in -= out;
+    }
+}
+
+void io_engine_splice_t::perform_write_op(off64_t offset, char *buf) {
+    check("Unused - if you see this, it's a bug in rebench", 1);
+}
+
+/**
+ * copy_file_range engine
+ **/
+void io_engine_copy_range_t::run_benchmark() {
+    if(config->operation == op_read)
+        copy_fd = open64(config->copy_file, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    else
+        copy_fd = open64(config->copy_file, O_RDONLY);
+    check("Error opening the copy file", copy_fd == -1);
+
+    io_engine_t::run_benchmark();
+
+    check("Could not close the copy file", close(copy_fd) == -1);
+}
+
+void io_engine_copy_range_t::perform_read_op(off64_t offset, char *buf) {
+    loff_t in_offset = offset, out_offset = offset;
+    ssize_t res = copy_file_range(fd, &in_offset, copy_fd, &out_offset, config->block_size, 0);
+    check("Error copying from device", res == -1);
+    check("Attempting to read from the end of the device", res == 0);
+}
+
+void io_engine_copy_range_t::perform_write_op(off64_t offset, char *buf) {
+    loff_t in_offset = offset, out_offset = offset;
+    ssize_t res = copy_file_range(copy_fd, &in_offset, fd, &out_offset, config->block_size, 0);
+    check("Error copying to device", res == -1);
+    check("Attempting to read from the end of the copy file", res == 0);
+    if(!config->buffered) {
+        if(config->do_atime)
+            check("Error syncing data", fsync(fd) == -1);
+        else
+            check("Error syncing data", fdatasync(fd) == -1);
+    }
+}
+
+/**
+ * null engine
+ **/
+void io_engine_null_t::perform_read_op(off64_t offset, char *buf) {
+}
+
+void io_engine_null_t::perform_write_op(off64_t offset, char *buf) {
+}
+
+void io_engine_null_t::perform_trim_op(off64_t offset) {
+}
+
+void io_engine_null_t::perform_sync_op() {
+}
+
+/**
+ * Metadata engine
+ **/
+// Threads of all workloads take the next one, so that workloads sharing a
+// directory don't touch each other's files
+static int meta_owners = 0;
+
+int io_engine_meta_t::contribute_open_flags() {
+    return O_RDONLY | O_DIRECTORY;
+}
+
+void io_engine_meta_t::post_open_setup() {
+    // Every level of the tree, top down; other workloads may have made
+    // some of it already
+    long long dirs = 1;
+    for(int level = 1; level <= config->dir_depth; level++) {
+        dirs *= config->dir_fanout;
+        for(long long dir = 0; dir < dirs; dir++) {
+            int res = mkdirat(fd, dir_path(dir, level).c_str(), 0755);
+            check("Could not create the directory tree", res == -1 && errno != EEXIST);
+        }
+    }
+}
+
+void io_engine_meta_t::run_benchmark() {
+    owner = __sync_fetch_and_add(&meta_owners, 1);
+    leaves = 1;
+    for(int level = 0; level < config->dir_depth; level++)
+        leaves *= config->dir_fanout;
+
+    // The starting files are made before the threads start together
+    rnd_gen_t rnd_gen = init_rnd_gen();
+    check("Error initializing random numbers", rnd_gen == NULL);
+    for(int i = 0; i < config->meta_files; i++)
+        create_file(rnd_gen);
+    free_rnd_gen(rnd_gen);
+
+    io_engine_t::run_benchmark();
+
+    for(int i = 0; i < names.size(); i++) {
+        int res = unlinkat(fd, file_path(names[i]).c_str(), 0);
+        check("Could not remove a file of the tree", res == -1);
+    }
+    names.clear();
+}
+
+int io_engine_meta_t::perform_op(char *buf, long long ops, rnd_gen_t rnd_gen) {
+    if(config->duration_unit == dut_interactive) {
+        char in;
+        // Ask for confirmation before the operation
+        printf("%lld: Press enter to perform operation, or 'q' to quit: ", ops);
+        in = getchar();
+        if(in == EOF || in == 'q') {
+            return 0;
+        }
+    }
+
+    meta_op_t op = pick_op(rnd_gen);
+    if(names.empty() && op != mop_fsync_dir)
+        op = mop_create;
+
+    int res, file_fd;
+    int file = op == mop_create || op == mop_fsync_dir ? -1 : pick_file(rnd_gen);
+    ticks_t time_start = get_ticks();
+    switch(op) {
+    case mop_create:
+        create_file(rnd_gen);
+        break;
+    case mop_stat: {
+        struct stat64 st;
+        res = fstatat64(fd, file_path(names[file]).c_str(), &st, 0);
+        check("Could not stat a file of the tree", res == -1);
+        break;
+    }
+    case mop_open:
+        file_fd = openat(fd, file_path(names[file]).c_str(), O_RDONLY | (config->do_atime ? 0 : O_NOATIME));
+        check("Could not open a file of the tree", file_fd == -1);
+        check("Could not close a file of the tree", close(file_fd) == -1);
+        break;
+    case mop_rename:
+        res = renameat(fd, file_path(names[file]).c_str(), fd, file_path(next_name).c_str());
+        check("Could not rename a file of the tree", res == -1);
+        names[file] = next_name++;
+        break;
+    case mop_unlink:
+        res = unlinkat(fd, file_path(names[file]).c_str(), 0);
+        check("Could not remove a file of the tree", res == -1);
+        names[file] = names.back();
+        names.pop_back();
+        break;
+    case mop_fsync_dir:
+        file_fd = openat(fd, dir_path(get_random(rnd_gen, rdt_uniform, leaves, 0), config->dir_depth).c_str(),
+                         O_RDONLY | O_DIRECTORY);
+        check("Could not open a directory of the tree", file_fd == -1);
+        check("Error syncing a directory of the tree", fsync(file_fd) == -1);
+        check("Could not close a directory of the tree", close(file_fd) == -1);
+        break;
+    default:
+        check("Invalid metadata op", 1);
+    }
+    push_meta_latency(op, get_ticks() - time_start);
+    last_offset = 0;
+    last_operation = config->operation;
+    last_size = 0;
+
+    return 1;
+}
+
+void io_engine_meta_t::perform_read_op(off64_t offset, char *buf) {
+    check("Unused - if you see this, it's a bug in rebench", 1);
+}
+
+void io_engine_meta_t::perform_write_op(off64_t offset, char *buf) {
+    check("Unused - if you see this, it's a bug in rebench", 1);
+}
+
+std::string io_engine_meta_t::dir_path(long long dir, int levels) {
+    std::string path;
+    char component[32];
+    for(int level = 0; level < levels; level++) {
+        snprintf(component, sizeof(component), "%sd%lld", level > 0 ? "/" : "", dir % config->dir_fanout);
+        path += component;
+        dir /= config->dir_fanout;
+    }
+    return path;
+}
+
+std::string io_engine_meta_t::file_path(long long name) {
+    // Consecutive names of a thread go round the bottom directories, and
+    // the pid keeps the files of concurrent runs apart
+    char file[64];
+    snprintf(file, sizeof(file), "/%d.%d.%lld", getpid(), owner, name);
+    return dir_path((owner + name) % leaves, config->dir_depth) + file;
+}
+
+int io_engine_meta_t::pick_file(rnd_gen_t rnd_gen) {
+    int file = get_random(rnd_gen, config->dist, names.size(), config->sigma);
+    return std::min(std::max(file, 0), (int)names.size() - 1);
+}
+
+meta_op_t io_engine_meta_t::pick_op(rnd_gen_t rnd_gen) {
+    int total = 0;
+    for(int i = 0; i < mop_count; i++)
+        total += config->meta_weights[i];
+    int pick = get_random_fraction(rnd_gen) * total;
+    int op = 0;
+    while(op < mop_count - 1 && pick >= config->meta_weights[op]) {
+        pick -= config->meta_weights[op];
+        op++;
+    }
+    return (meta_op_t)op;
+}
+
+void io_engine_meta_t::create_file(rnd_gen_t rnd_gen) {
+    int file_fd = openat(fd, file_path(next_name).c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+    check("Could not create a file of the tree", file_fd == -1);
+    check("Could not close a file of the tree", close(file_fd) == -1);
+    names.push_back(next_name++);
+}
+
+void io_engine_meta_t::push_meta_latency(meta_op_t op, ticks_t latency) {
+    if(meta_stats == NULL)
+        return;
+    int res = pthread_mutex_lock(latency_mutex);
+    check("Could not lock latency mutex", res != 0);
+    meta_stats[op]->add(latency);
+    res = pthread_mutex_unlock(latency_mutex);
+    check("Could not unlock latency mutex", res != 0);
+}
+
+/**
+ * Object engine
+ **/
+void io_engine_object_t::run_benchmark() {
+    int res = posix_memalign((void**)&object_buf, getpagesize(), config->object_max_size);
+    check("Error allocating memory", res != 0);
+
+    io_engine_meta_t::run_benchmark();
+
+    free(object_buf);
+    object_buf = NULL;
+}
+
+int io_engine_object_t::perform_op(char *buf, long long ops, rnd_gen_t rnd_gen) {
+    if(config->duration_unit == dut_interactive) {
+        char in;
+        // Ask for confirmation before the operation
+        printf("%lld: Press enter to perform operation, or 'q' to quit: ", ops);
+        in = getchar();
+        if(in == EOF || in == 'q') {
+            return 0;
+        }
+    }
+
+    std::string path = file_path(names[pick_file(rnd_gen)]);
+    if(config->operation == op_read) {
+        int file_fd = openat(fd, path.c_str(), O_RDONLY | (config->do_atime ? 0 : O_NOATIME));
+        check("Could not open an object", file_fd == -1);
+        ssize_t res;
+        last_size = 0;
+        while((res = read(file_fd, object_buf, config->object_max_size)) > 0)
+            last_size += res;
+        check("Error reading an object", res == -1);
+        check("Could not close an object", close(file_fd) == -1);
+        object_bytes += last_size;
+    } else {
+        int size = pick_size(rnd_gen);
+        if(config->object_rename) {
+            std::string tmp_path = path + ".tmp";
+            write_object(tmp_path.c_str(), O_CREAT | O_EXCL, size);
+            int res = renameat(fd, tmp_path.c_str(), fd, path.c_str());
+            check("Could not rename an object into place", res == -1);
+        } else {
+            write_object(path.c_str(), O_TRUNC, size);
+        }
+        object_bytes += size;
+        last_size = size;
+    }
+    last_offset = 0;
+    last_operation = config->operation;
+
+    return 1;
+}
+
+void io_engine_object_t::create_file(rnd_gen_t rnd_gen) {
+    write_object(file_path(next_name).c_str(), O_CREAT | O_EXCL, pick_size(rnd_gen));
+    names.push_back(next_name++);
+}
+
+int io_engine_object_t::pick_size(rnd_gen_t rnd_gen) {
+    int range = config->object_max_size - config->object_min_size;
+    if(range == 0)
+        return config->object_min_size;
+    off64_t size = get_random(rnd_gen, config->object_size_dist, range + 1, OBJECT_SIZE_SIGMA);
+    return config->object_min_size + std::min(std::max(size, (off64_t)0), (off64_t)range);
+}
+
+void io_engine_object_t::write_object(const char *path, int flags, int size) {
+    int file_fd = openat(fd, path, O_WRONLY | flags, 0644);
+    check("Could not open an object for writing", file_fd == -1);
+    for(int done = 0; done < size; ) {
+        ssize_t res = write(file_fd, object_buf + done, size - done);
+        check("Error writing an object", res == -1);
+        done += res;
+    }
+    if(config->object_fsync)
+        check("Error syncing an object", fsync(file_fd) == -1);
+    check("Could not close an object", close(file_fd) == -1);
 }
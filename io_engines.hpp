@@ -3,23 +3,24 @@
 #define __IO_ENGINES_HPP__
 
 #include <libaio.h>
+#include <string>
+#include <vector>
 #include "io_engine.hpp"
 
 // Stateful engine
 class io_engine_stateful_t : public io_engine_t {
 public:
-    io_engine_stateful_t(std::vector<ticks_t> *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
+    io_engine_stateful_t(latency_buffer_t *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
         : io_engine_t(_latencies, _stream_stat, _latency_mutex)
         {}
     virtual void perform_read_op(off64_t offset, char *buf);
     virtual void perform_write_op(off64_t offset, char *buf);
-    virtual void perform_trim_op(off64_t offset);
 };
 
 // Stateless engine
 class io_engine_stateless_t : public io_engine_t {
 public:
-    io_engine_stateless_t(std::vector<ticks_t> *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
+    io_engine_stateless_t(latency_buffer_t *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
         : io_engine_t(_latencies, _stream_stat, _latency_mutex)
         {}
     virtual void perform_read_op(off64_t offset, char *buf);
@@ -29,7 +30,7 @@ public:
 // PAIO engine
 class io_engine_paio_t : public io_engine_t {
 public:
-    io_engine_paio_t(std::vector<ticks_t> *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
+    io_engine_paio_t(latency_buffer_t *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
         : io_engine_t(_latencies, _stream_stat, _latency_mutex)
         {}
     virtual void post_open_setup();
@@ -41,17 +42,21 @@ public:
 
     void perform_read_op(off64_t offset, char *buf, aiocb64 *request);
     void perform_write_op(off64_t offset, char *buf, aiocb64 *request);
+    void perform_sync_op(aiocb64 *request);
     int perform_op(char *buf, aiocb64 *request, long long ops, rnd_gen_t rnd_gen);
 
 private:
     void set_timestamp(aiocb64 *request);
+    // Submits the current step of the sequence of the request slot
+    void perform_step(char *buf, aiocb64 *request);
     aiocb64 *requests;
+    sequence_t *sequences; // a sequence per request, with a pattern
 };
 
 // PAIO engine
 class io_engine_naio_t : public io_engine_t {
 public:
-    io_engine_naio_t(std::vector<ticks_t> *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
+    io_engine_naio_t(latency_buffer_t *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
         : io_engine_t(_latencies, _stream_stat, _latency_mutex)
         {}
     virtual void perform_read_op(off64_t offset, char *buf);
@@ -62,34 +67,185 @@ public:
 
     void perform_read_op(off64_t offset, char *buf, iocb *request);
     void perform_write_op(off64_t offset, char *buf, iocb *request);
+    void perform_sync_op(iocb *request);
     int perform_op(char *buf, iocb *request, long long ops, rnd_gen_t rnd_gen);
 
 private:
     void set_timestamp(iocb *request);
+    // Submits the current step of the sequence of the request slot
+    void perform_step(char *buf, iocb *request);
+    void submit_request(iocb *request);
     io_context_t ctx_id;
     iocb *requests;
+    sequence_t *sequences; // a sequence per request, with a pattern
     int notification_fd;
 };
 
 // mmap engine
 class io_engine_mmap_t : public io_engine_t {
 public:
-    io_engine_mmap_t(std::vector<ticks_t> *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
-        : io_engine_t(_latencies, _stream_stat, _latency_mutex)
+    io_engine_mmap_t(latency_buffer_t *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
+        : io_engine_t(_latencies, _stream_stat, _latency_mutex),
+          map(NULL), map_offset(0), map_length(0),
+          dirty_writes(0)
         {}
     virtual int contribute_open_flags();
     virtual void post_open_setup();
     virtual void pre_close_teardown();
 
+    virtual void run_benchmark();
+
     virtual void perform_read_op(off64_t offset, char *buf);
     virtual void perform_write_op(off64_t offset, char *buf);
 
     virtual void copy_io_state(io_engine_t *io_engine);
+
+protected:
+    virtual void flush_full_batches();
     
 private:
+    // Returns the address of the given device offset, sliding the
+    // window over it first if necessary.
+    char* map_address(off64_t offset);
+    // The bytes of the block at offset that lie within the device, a
+    // file can't be mapped past its end
+    off64_t op_length(off64_t offset);
+    void map_window(off64_t offset, off64_t length);
+    void unmap_window();
+    // Flushes the pages dirtied since the last flush
+    void flush_dirty_range();
+
     void *map;
+    off64_t map_offset;
+    off64_t map_length;
+
+    // Page aligned device ranges written since the last flush
+    std::vector<std::pair<off64_t, off64_t> > dirty_ranges;
+    int dirty_writes;
+};
+
+// sendfile engine
+class io_engine_sendfile_t : public io_engine_t {
+public:
+    io_engine_sendfile_t(latency_buffer_t *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
+        : io_engine_t(_latencies, _stream_stat, _latency_mutex),
+          sink_fd(-1)
+        {}
+    virtual void run_benchmark();
+
+    virtual void perform_read_op(off64_t offset, char *buf);
+    virtual void perform_write_op(off64_t offset, char *buf);
+
+private:
+    int sink_fd;
+};
+
+// splice engine
+class io_engine_splice_t : public io_engine_t {
+public:
+    io_engine_splice_t(latency_buffer_t *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
+        : io_engine_t(_latencies, _stream_stat, _latency_mutex),
+          sink_fd(-1)
+        {}
+    virtual void run_benchmark();
+
+    virtual void perform_read_op(off64_t offset, char *buf);
+    virtual void perform_write_op(off64_t offset, char *buf);
+
+private:
+    int pipe_fds[2];
+    int sink_fd;
 };
 
+// copy_file_range engine
+class io_engine_copy_range_t : public io_engine_t {
+public:
+    io_engine_copy_range_t(latency_buffer_t *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
+        : io_engine_t(_latencies, _stream_stat, _latency_mutex),
+          copy_fd(-1)
+        {}
+    virtual void run_benchmark();
+
+    virtual void perform_read_op(off64_t offset, char *buf);
+    virtual void perform_write_op(off64_t offset, char *buf);
+
+private:
+    int copy_fd;
+};
+
+// null engine, runs the benchmark loop without doing any IO to measure
+// the overhead of rebench itself
+class io_engine_null_t : public io_engine_t {
+public:
+    io_engine_null_t(latency_buffer_t *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
+        : io_engine_t(_latencies, _stream_stat, _latency_mutex)
+        {}
+
+    virtual void perform_read_op(off64_t offset, char *buf);
+    virtual void perform_write_op(off64_t offset, char *buf);
+    virtual void perform_trim_op(off64_t offset);
+    virtual void perform_sync_op();
+};
+
+// Metadata engine, creates, stats, opens, renames and unlinks files in a
+// tree of directories under DEVICE instead of doing data IO. Every thread
+// works on files of its own.
+class io_engine_meta_t : public io_engine_t {
+public:
+    io_engine_meta_t(latency_buffer_t *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
+        : io_engine_t(_latencies, _stream_stat, _latency_mutex),
+          owner(0), leaves(0), next_name(0)
+        {}
+    virtual int contribute_open_flags();
+    virtual void post_open_setup();
+
+    virtual void run_benchmark();
+
+    virtual int perform_op(char *buf, long long ops, rnd_gen_t rnd_gen);
+    virtual void perform_read_op(off64_t offset, char *buf);
+    virtual void perform_write_op(off64_t offset, char *buf);
+
+protected:
+    // Paths relative to DEVICE of a directory of the tree (the first
+    // levels of it) and of a file of the thread
+    std::string dir_path(long long dir, int levels);
+    std::string file_path(long long name);
+    // Index into names of a file of the thread, following the distribution
+    int pick_file(rnd_gen_t rnd_gen);
+    void push_meta_latency(meta_op_t op, ticks_t latency);
+    // Makes a new file of the thread and adds it to names
+    virtual void create_file(rnd_gen_t rnd_gen);
+
+    int owner; // tells apart the files of the threads
+    long long leaves; // directories at the bottom of the tree
+    std::vector<long long> names; // files of the thread
+    long long next_name;
+
+private:
+    meta_op_t pick_op(rnd_gen_t rnd_gen);
+};
+
+// Every op opens a file of the tree, reads or writes all of it and closes
+// it, the files standing for objects of a store
+class io_engine_object_t : public io_engine_meta_t {
+public:
+    io_engine_object_t(latency_buffer_t *_latencies, stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
+        : io_engine_meta_t(_latencies, _stream_stat, _latency_mutex),
+          object_buf(NULL)
+        {}
+    virtual void run_benchmark();
+
+    virtual int perform_op(char *buf, long long ops, rnd_gen_t rnd_gen);
+
+protected:
+    virtual void create_file(rnd_gen_t rnd_gen);
+
+private:
+    int pick_size(rnd_gen_t rnd_gen);
+    void write_object(const char *path, int flags, int size);
+
+    char *object_buf; // room for the largest object
+};
 
 #endif // __IO_ENGINES_HPP__
 
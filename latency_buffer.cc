@@ -0,0 +1,75 @@
+
+#include <stdlib.h>
+#include "latency_buffer.hpp"
+
+latency_buffer_t::latency_buffer_t(int _capacity, latency_capture_t _mode)
+    : sum_latency(0), min_latency(1000000000L), max_latency(0),
+      capacity(_capacity), mode(_mode), active_seen(0), seen(0), sampled_out(0)
+{
+    active = (ticks_t*)malloc(sizeof(ticks_t) * capacity);
+    check("Error allocating memory", active == NULL);
+    spare = (ticks_t*)malloc(sizeof(ticks_t) * capacity);
+    check("Error allocating memory", spare == NULL);
+    init_std_dev(&std_dev);
+    rnd_state = get_ticks() | 1;
+}
+
+latency_buffer_t::~latency_buffer_t() {
+    free(active);
+    free(spare);
+}
+
+void latency_buffer_t::add(ticks_t latency) {
+    sum_latency += latency;
+    if(latency < min_latency)
+        min_latency = latency;
+    if(latency > max_latency)
+        max_latency = latency;
+    add_to_std_dev(&std_dev, latency);
+    seen++;
+
+    if(active_seen < capacity) {
+        active[active_seen++] = latency;
+        return;
+    }
+
+    sampled_out++;
+    if(mode == lct_ring) {
+        active[active_seen++ % capacity] = latency;
+    } else {
+        // Keep the new latency with probability capacity / seen
+        rnd_state ^= rnd_state << 13;
+        rnd_state ^= rnd_state >> 7;
+        rnd_state ^= rnd_state << 17;
+        long long slot = rnd_state % (unsigned long long)(++active_seen);
+        if(slot < capacity)
+            active[slot] = latency;
+    }
+}
+
+ticks_t* latency_buffer_t::take(int *count, int *first) {
+    ticks_t *batch = active;
+    *count = active_seen < capacity ? active_seen : capacity;
+    // The caller reads a wrapped ring from its oldest entry, outside of
+    // the lock
+    *first = mode == lct_ring && active_seen > capacity ? active_seen % capacity : 0;
+    active = spare;
+    spare = batch;
+    active_seen = 0;
+    return batch;
+}
+
+void latency_buffer_t::reset_stats() {
+    sum_latency = 0;
+    min_latency = 1000000000L;
+    max_latency = 0;
+    init_std_dev(&std_dev);
+}
+
+long long latency_buffer_t::get_seen() {
+    return seen;
+}
+
+long long latency_buffer_t::get_sampled_out() {
+    return sampled_out;
+}
@@ -0,0 +1,49 @@
+#ifndef __LATENCY_BUFFER_HPP__
+#define __LATENCY_BUFFER_HPP__
+
+#include "utils.hpp"
+
+// Fixed capacity capture of per-op latencies (used when sample_step
+// is zero). Engines add latencies while holding the latency mutex, the
+// monitor takes the captured batch under the same mutex and processes
+// it outside of it. Once a batch is full, further latencies are either
+// reservoir sampled (every op of the batch has the same chance of being
+// kept) or overwrite the oldest entries (ring). Sum, min, max and
+// deviation are always computed over every op.
+class latency_buffer_t {
+public:
+    latency_buffer_t(int _capacity, latency_capture_t _mode);
+    ~latency_buffer_t();
+
+    void add(ticks_t latency);
+
+    // Swaps the captured batch out and returns it, count is set to the
+    // number of latencies in it and first to the index of the oldest one
+    // (non-zero once a ring has wrapped). The batch stays valid until the
+    // next call to take.
+    ticks_t* take(int *count, int *first);
+
+    // Restarts sum, min, max and deviation, the capture is kept
+    void reset_stats();
+
+    long long get_seen();
+    long long get_sampled_out();
+
+    unsigned long long sum_latency;
+    unsigned long long min_latency, max_latency;
+    std_dev_t std_dev;
+
+private:
+    int capacity;
+    latency_capture_t mode;
+
+    ticks_t *active;
+    ticks_t *spare;
+    long long active_seen;
+
+    long long seen;
+    long long sampled_out;
+    unsigned long long rnd_state;
+};
+
+#endif // __LATENCY_BUFFER_HPP__
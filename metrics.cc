@@ -0,0 +1,231 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "metrics.hpp"
+
+metrics_server_t::metrics_server_t(const char *address, int workloads)
+    : samples(workloads), listen_fd(-1), is_done(0)
+{
+    pthread_mutex_init(&samples_mutex, NULL);
+
+    if(strspn(address, "0123456789") == strlen(address)) {
+        sockaddr_in addr;
+        bzero(&addr, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(address));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        check("Could not create the metrics socket", listen_fd == -1);
+        int reuse = 1;
+        check("Could not set up the metrics socket",
+              setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0);
+        check("Could not bind the metrics port",
+              bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0);
+    } else {
+        sockaddr_un addr;
+        bzero(&addr, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        check("Metrics socket path is too long", strlen(address) >= sizeof(addr.sun_path));
+        strcpy(addr.sun_path, address);
+
+        // Replace a socket left behind by an earlier run, but nothing else
+        struct stat st;
+        if(stat(address, &st) == 0 && S_ISSOCK(st.st_mode))
+            unlink(address);
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        check("Could not create the metrics socket", listen_fd == -1);
+        check("Could not bind the metrics socket",
+              bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0);
+        socket_path = address;
+    }
+    check("Could not listen on the metrics socket", listen(listen_fd, 16) != 0);
+}
+
+metrics_server_t::~metrics_server_t() {
+    pthread_mutex_destroy(&samples_mutex);
+}
+
+void metrics_server_t::start() {
+    check("Error creating metrics thread",
+          pthread_create(&thread, NULL, &server_worker, (void*)this) != 0);
+}
+
+void metrics_server_t::stop() {
+    __atomic_store_n(&is_done, 1, __ATOMIC_RELEASE);
+    check("Error joining metrics thread",
+          pthread_join(thread, NULL) != 0);
+    check("Could not close the metrics socket", close(listen_fd) == -1);
+    if(!socket_path.empty())
+        unlink(socket_path.c_str());
+}
+
+void metrics_server_t::update(int workload, const metrics_sample_t &sample) {
+    check("Could not lock metrics mutex", pthread_mutex_lock(&samples_mutex) != 0);
+    samples[workload] = sample;
+    check("Could not unlock metrics mutex", pthread_mutex_unlock(&samples_mutex) != 0);
+}
+
+void* metrics_server_t::server_worker(void *arg) {
+    metrics_server_t *server = (metrics_server_t*)arg;
+    while(!__atomic_load_n(&server->is_done, __ATOMIC_ACQUIRE)) {
+        // Wake up regularly to notice the end of the run
+        pollfd pfd;
+        pfd.fd = server->listen_fd;
+        pfd.events = POLLIN;
+        int res = poll(&pfd, 1, 100);
+        if(res <= 0)
+            continue;
+        int client_fd = accept(server->listen_fd, NULL, NULL);
+        if(client_fd == -1)
+            continue;
+        server->serve(client_fd);
+        close(client_fd);
+    }
+    return NULL;
+}
+
+void metrics_server_t::serve(int client_fd) {
+    // Read the request line, a slow or broken client is dropped rather
+    // than allowed to hold up the next scrape
+    char request[4096];
+    int size = 0;
+    request[0] = 0;
+    while(size < sizeof(request) - 1 && strstr(request, "\r\n") == NULL) {
+        pollfd pfd;
+        pfd.fd = client_fd;
+        pfd.events = POLLIN;
+        if(poll(&pfd, 1, 1000) <= 0)
+            return;
+        int res = read(client_fd, request + size, sizeof(request) - 1 - size);
+        if(res <= 0)
+            return;
+        size += res;
+        request[size] = 0;
+    }
+
+    std::string response;
+    if(strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0) {
+        std::string body = render();
+        char header[256];
+        snprintf(header, sizeof(header),
+                 "HTTP/1.0 200 OK\r\n"
+                 "Content-Type: text/plain; version=0.0.4\r\n"
+                 "Content-Length: %d\r\n\r\n", (int)body.size());
+        response = header + body;
+    } else {
+        response = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    }
+
+    int written = 0;
+    while(written < response.size()) {
+        int res = write(client_fd, response.data() + written, response.size() - written);
+        if(res <= 0)
+            return;
+        written += res;
+    }
+}
+
+static std::string escape_label(const std::string &value) {
+    std::string escaped;
+    for(int i = 0; i < value.size(); i++) {
+        if(value[i] == '\\' || value[i] == '"')
+            escaped += '\\';
+        if(value[i] == '\n')
+            escaped += "\\n";
+        else
+            escaped += value[i];
+    }
+    return escaped;
+}
+
+static void add_metric(std::string &out, const char *name, const char *type, const char *help) {
+    out += std::string("# HELP ") + name + " " + help + "\n";
+    out += std::string("# TYPE ") + name + " " + type + "\n";
+}
+
+static void add_value(std::string &out, const char *name, const std::string &labels, long long value) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), " %lld\n", value);
+    out += std::string(name) + "{" + labels + "}" + buf;
+}
+
+static void add_value(std::string &out, const char *name, const std::string &labels, double value) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), " %.9g\n", value);
+    out += std::string(name) + "{" + labels + "}" + buf;
+}
+
+std::string metrics_server_t::render() {
+    check("Could not lock metrics mutex", pthread_mutex_lock(&samples_mutex) != 0);
+    std::vector<metrics_sample_t> _samples = samples;
+    check("Could not unlock metrics mutex", pthread_mutex_unlock(&samples_mutex) != 0);
+
+    std::vector<std::string> labels;
+    for(int i = 0; i < _samples.size(); i++) {
+        char workload[16];
+        snprintf(workload, sizeof(workload), "%d", i + 1);
+        labels.push_back(std::string("workload=\"") + workload +
+                         "\",device=\"" + escape_label(_samples[i].device) +
+                         "\",operation=\"" + _samples[i].operation +
+                         "\",type=\"" + _samples[i].type + "\"");
+    }
+
+    std::string out;
+    add_metric(out, "rebench_ops_total", "counter", "Operations completed.");
+    for(int i = 0; i < _samples.size(); i++)
+        add_value(out, "rebench_ops_total", labels[i], _samples[i].ops);
+
+    add_metric(out, "rebench_bytes_total", "counter", "Bytes transferred.");
+    for(int i = 0; i < _samples.size(); i++)
+        add_value(out, "rebench_bytes_total", labels[i], _samples[i].bytes);
+
+    add_metric(out, "rebench_iops", "gauge", "Operations per second over the last sample step.");
+    for(int i = 0; i < _samples.size(); i++)
+        add_value(out, "rebench_iops", labels[i], _samples[i].ops_per_sec);
+
+    add_metric(out, "rebench_throughput_bytes_per_second", "gauge", "Bytes per second over the last sample step.");
+    for(int i = 0; i < _samples.size(); i++)
+        add_value(out, "rebench_throughput_bytes_per_second", labels[i], _samples[i].bytes_per_sec);
+
+    add_metric(out, "rebench_latency_seconds", "gauge", "Latency percentiles over the last sample step.");
+    for(int i = 0; i < _samples.size(); i++) {
+        std::map<double, ticks_t> &percentiles = _samples[i].percentiles;
+        for(std::map<double, ticks_t>::iterator it = percentiles.begin(); it != percentiles.end(); ++it) {
+            char quantile[64];
+            snprintf(quantile, sizeof(quantile), ",quantile=\"%g\"", it->first);
+            add_value(out, "rebench_latency_seconds", labels[i] + quantile, it->second / 1000000000.0);
+        }
+    }
+
+    add_metric(out, "rebench_latency_mean_seconds", "gauge", "Mean latency over the last sample step.");
+    for(int i = 0; i < _samples.size(); i++)
+        add_value(out, "rebench_latency_mean_seconds", labels[i], _samples[i].mean_latency / 1000000000.0);
+
+    add_metric(out, "rebench_latency_max_seconds", "gauge", "Max latency over the last sample step.");
+    for(int i = 0; i < _samples.size(); i++)
+        add_value(out, "rebench_latency_max_seconds", labels[i], _samples[i].max_latency / 1000000000.0);
+
+    add_metric(out, "rebench_in_flight", "gauge", "Operations submitted and not yet completed.");
+    for(int i = 0; i < _samples.size(); i++)
+        add_value(out, "rebench_in_flight", labels[i], (long long)_samples[i].in_flight);
+
+    add_metric(out, "rebench_done", "gauge", "Whether the workload has finished.");
+    for(int i = 0; i < _samples.size(); i++)
+        add_value(out, "rebench_done", labels[i], (long long)_samples[i].done);
+
+    add_metric(out, "rebench_phase", "gauge", "Index of the current phase, -1 without phases.");
+    for(int i = 0; i < _samples.size(); i++)
+        add_value(out, "rebench_phase", labels[i], (long long)_samples[i].phase);
+
+    return out;
+}
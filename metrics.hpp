@@ -0,0 +1,59 @@
+#ifndef __METRICS_HPP__
+#define __METRICS_HPP__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "utils.hpp"
+
+// The latest stats of a workload, as published by the monitor at every
+// sample step
+struct metrics_sample_t {
+    metrics_sample_t()
+        : ops(0), bytes(0), ops_per_sec(0), bytes_per_sec(0),
+          mean_latency(0), max_latency(0), in_flight(0), done(0), phase(-1)
+        {}
+
+    std::string device;
+    std::string operation;
+    std::string type;
+    long long ops;
+    long long bytes;
+    long long ops_per_sec;
+    double bytes_per_sec;
+    double mean_latency; // ticks
+    ticks_t max_latency;
+    std::map<double, ticks_t> percentiles;
+    int in_flight;
+    int done;
+    int phase; // -1 without phases
+};
+
+// Serves the samples of every workload in the Prometheus text format
+// over HTTP from a background thread. The address is either a TCP port
+// (bound to localhost) or the path of a Unix socket.
+class metrics_server_t {
+public:
+    metrics_server_t(const char *address, int workloads);
+    ~metrics_server_t();
+
+    void start();
+    void stop();
+
+    void update(int workload, const metrics_sample_t &sample);
+
+private:
+    static void* server_worker(void *arg);
+    void serve(int client_fd);
+    std::string render();
+
+    std::vector<metrics_sample_t> samples;
+    pthread_mutex_t samples_mutex;
+    std::string socket_path;
+    int listen_fd;
+    int is_done;
+    pthread_t thread;
+};
+
+#endif // __METRICS_HPP__
@@ -6,8 +6,42 @@
 #include <algorithm>
 #include "opts.hpp"
 #include "utils.hpp"
+#include "stream_stat.hpp"
+#include "file_set.hpp"
 
 const int OUTPUT_FLAG = 1024;
+const int MMAP_WINDOW_FLAG = 1025;
+const int MADVISE_FLAG = 1026;
+const int MSYNC_BATCH_FLAG = 1027;
+const int COPY_FILE_FLAG = 1028;
+const int TRIM_MODE_FLAG = 1029;
+const int TRIM_BATCH_FLAG = 1030;
+const int TRACE_FLAG = 1031;
+const int LATENCY_CAPACITY_FLAG = 1032;
+const int LATENCY_CAPTURE_FLAG = 1033;
+const int HISTOGRAM_FLAG = 1034;
+const int FORMAT_FLAG = 1035;
+const int PERCENTILES_FLAG = 1036;
+const int METRICS_FLAG = 1037;
+const int CLOCK_FLAG = 1038;
+const int WARMUP_FLAG = 1039;
+const int STEADY_STATE_FLAG = 1040;
+const int PRECONDITION_FLAG = 1041;
+const int PRECONDITION_BS_FLAG = 1042;
+const int PRECONDITION_TIME_FLAG = 1043;
+const int PRECONDITION_STATE_FLAG = 1044;
+const int PHASE_FLAG = 1045;
+const int REPEAT_FLAG = 1046;
+const int BASELINE_FLAG = 1047;
+const int FILE_SELECT_FLAG = 1048;
+const int FD_CACHE_FLAG = 1049;
+const int META_OPS_FLAG = 1050;
+const int DIR_TREE_FLAG = 1051;
+const int META_FILES_FLAG = 1052;
+const int OBJECT_SIZE_FLAG = 1053;
+const int OBJECT_FSYNC_FLAG = 1054;
+const int OBJECT_RENAME_FLAG = 1055;
+const int PATTERN_FLAG = 1056;
 
 int HARDWARE_BLOCK_SIZE = 512;
 
@@ -16,6 +50,7 @@ void print_size(off64_t size);
 void init_workload_config(workload_config_t *config) {
     bzero(config, sizeof(*config));
     config->silent = 0;
+    config->format = ofm_text;
     config->threads = 1;
     config->block_size = HARDWARE_BLOCK_SIZE;
     config->duration = 10;
@@ -23,6 +58,10 @@ void init_workload_config(workload_config_t *config) {
     config->stride = HARDWARE_BLOCK_SIZE;
     config->device[0] = NULL;
     config->output_file[0] = NULL;
+    config->copy_file[0] = NULL;
+    config->trace_file[0] = NULL;
+    config->histogram_file[0] = NULL;
+    config->metrics_address[0] = NULL;
     config->offset = 0;
     config->length = 0;
     config->direct_io = 1;
@@ -38,9 +77,51 @@ void init_workload_config(workload_config_t *config) {
     config->dist = rdt_uniform;
     config->sigma = -1;
     config->sample_step = 1000;
+    config->percentile_mark_count = 0;
+    config->latency_capacity = 1000000;
+    config->latency_capture = lct_reservoir;
     config->pause_interval = 0;
     config->drop_caches = 0;
     config->use_eventfd = 0;    
+    config->perf = 0;
+    config->device_stats = 0;
+    config->clock_source = cls_monotonic;
+    config->calibrate = 1;
+    config->warmup = 0;
+    config->warmup_unit = dut_time;
+    config->steady_state_rounds = 0;
+    config->precondition_passes = -1;
+    config->precondition_block_size = 4096;
+    config->precondition_time = 1800;
+    config->precondition_state[0] = NULL;
+    config->fill = 0;
+    config->file_set = 0;
+    config->file_select = fsl_uniform;
+    config->zipf_exponent = 1.0;
+    config->files_per_thread = 0;
+    config->fd_cache = 0;
+    for(int i = 0; i < mop_count; i++)
+        config->meta_weights[i] = i == mop_fsync_dir ? 0 : 1;
+    config->dir_fanout = 16;
+    config->dir_depth = 2;
+    config->meta_files = 1024;
+    config->object_min_size = 0; // the block size unless given
+    config->object_max_size = 0;
+    config->object_size_dist = rdt_const;
+    config->object_fsync = 0;
+    config->object_rename = 0;
+    config->pattern = pat_none;
+    config->journal_offset = 0;
+    config->repeat = 1;
+    config->baseline_file[0] = NULL;
+    config->phase_count = 0;
+    config->mmap_window = 0;
+    config->mmap_populate = 0;
+    config->mmap_advice = mad_normal;
+    config->msync_async = 0;
+    config->msync_batch = 1;
+    config->trim_mode = trm_auto;
+    config->trim_batch = 0;
 }
 
 void usage(const char *name) {
@@ -52,7 +133,12 @@ void usage(const char *name) {
            "\tto specify multiple concurrent workloads.\n", name);
     
     printf("\nArguments:\n");
-    printf("\tDEVICE - device or file name to perform operations on.\n");
+    printf("\tDEVICE - device or file name to perform operations on. A directory, a glob\n");
+    printf("\t(quote it from the shell) or '@' followed by a file listing one path per\n");
+    printf("\tline makes a file set: every op picks a file of the set (see --file-select)\n");
+    printf("\tand falls into the range given by --offset and --length in that file.\n");
+    printf("\tFiles too small for a block in the range are left out. For 'meta' and\n");
+    printf("\t'object' runs, DEVICE is the directory to build the tree of --dir-tree in.\n");
     
     printf("\nOptions:\n");
     printf("\t-d, --duration\n\t\tDuration of the benchmark in seconds.\n");
@@ -63,6 +149,54 @@ void usage(const char *name) {
     printf("\t\tset to 'i', rebench will run commands interactively (useful for\n");
     printf("\t\tdebugging with btrace, and only available in single-threaded mode).\n");
     
+    printf("\t--warmup\n\t\tRun the workload for this long before measuring (in seconds, or an\n");
+    printf("\t\tamount of data with 'k', 'm', 'g' or '%%' as for --duration). Warmup ops\n");
+    printf("\t\tare performed but left out of the latency stats, throughput and\n");
+    printf("\t\tduration. CPU usage still covers the whole run.\n");
+
+    printf("\t--steady-state\n\t\tEnd the run once throughput reaches steady state, with --duration as\n");
+    printf("\t\tthe cap. Takes the measurement window in sample steps (at least 2). The\n");
+    printf("\t\tworkload is steady once the ops/sec of the window stay within %d%% of their\n", (int)(STEADY_STATE_RANGE * 100));
+    printf("\t\tmean and their fitted trend changes by at most %d%% over the window (as in\n", (int)(STEADY_STATE_SLOPE * 100));
+    printf("\t\tthe SNIA performance test specification). Results then cover the window\n");
+    printf("\t\tonly, except for device stats which start after the warmup. Needs a\n");
+    printf("\t\tnon-zero sample step.\n");
+    
+    printf("\t--phase\n\t\tAdd a phase to the run, as NAME:SECS[:RATE]. RATE caps the ops/sec of\n");
+    printf("\t\tthe whole workload during the phase, 'idle' stops it and leaving it out\n");
+    printf("\t\truns unthrottled. Repeat the option for every phase; the run goes through\n");
+    printf("\t\tthem in order (after any warmup, which uses the first phase) and its\n");
+    printf("\t\tduration is their sum. Samples are tagged with their phase. To change\n");
+    printf("\t\tthe mix or the queue depth between phases, run several workloads from\n");
+    printf("\t\tstandard input that are idle in each other's phases.\n");
+
+    printf("\t--repeat\n\t\tRun all the workloads this many times, each time with fresh state\n");
+    printf("\t\t(and dropped caches with --drop-caches), then report the mean, standard\n");
+    printf("\t\tdeviation and 95%% confidence interval of the ops/sec and of every latency\n");
+    printf("\t\tpercentile over the runs. Preconditioning and calibration happen once;\n");
+    printf("\t\t--output, --histogram and --trace get a file per run, suffixed .1, .2, ...\n");
+
+    printf("\t--baseline\n\t\tCompare the runs of --repeat with a baseline, the JSON output of an\n");
+    printf("\t\tearlier --repeat run. Metrics significantly worse than in the baseline (by\n");
+    printf("\t\tWelch's t-test at the 5%% level over all the metrics) are flagged as\n");
+    printf("\t\tregressions and rebench exits with status 2.\n");
+
+    printf("\t--precondition\n\t\tPrecondition the device before the workload (this overwrites the data\n");
+    printf("\t\tbetween --offset and --length). Takes the number of sequential passes\n");
+    printf("\t\twriting the whole range, which are followed by random writes until\n");
+    printf("\t\tthroughput reaches steady state (see --steady-state, over %d sample steps).\n", PRECONDITION_ROUNDS);
+    printf("\t\tBoth use native AIO, direct IO and a queue depth of %d (POSIX AIO where\n", PRECONDITION_QUEUE_DEPTH);
+    printf("\t\tnative AIO or direct IO is unavailable, flushed after every step). Progress is\n");
+    printf("\t\tpublished on --metrics like the workload itself, and written to --output\n");
+    printf("\t\tahead of the lines of the run, each ending with 'precondition'.\n");
+
+    printf("\t--precondition-bs\n\t\tBlock size of the random preconditioning writes (4k by default).\n");
+
+    printf("\t--precondition-time\n\t\tCap on the random preconditioning writes in seconds (1800 by default).\n");
+
+    printf("\t--precondition-state\n\t\tA file recording the finished preconditioning steps. A run\n");
+    printf("\t\tinterrupted during preconditioning resumes after the last finished pass.\n");
+    
     printf("\t-c, --threads\n\t\tNumbers of threads used to run the benchmark.\n");
     printf("\t-b, --block_size\n\t\tSize of blocks in bytes to use for IO operations.\n");
     printf("\t\tBlock size can also be specified in units other than bytes by appending\n");
@@ -80,7 +214,64 @@ void usage(const char *name) {
     printf("\t\tValid options are 'stateful' for read/write IO,\n" \
            "\t\t'stateless' for pread/pwrite type of IO, 'mmap' for\n" \
            "\t\tmemory mapping, 'paio' for POSIX asynchronous IO,\n" \
-           "\t\tand 'naio' for native OS asynchronous IO.\n");
+           "\t\t'naio' for native OS asynchronous IO, 'sendfile' for sendfile\n" \
+           "\t\tto /dev/null, 'splice' for splicing through a pipe to /dev/null,\n" \
+           "\t\t'copyrange' for copy_file_range between DEVICE and --copy-file,\n" \
+           "\t\t'null' for running the benchmark loop without doing any IO,\n" \
+           "\t\t'meta' for metadata ops on files instead of data IO (see --meta-ops),\n" \
+           "\t\tand 'object' for opening, reading or writing in full and closing a\n" \
+           "\t\tsmall file per op (see --object-size).\n");
+
+    printf("\t--meta-ops\n\t\tThe ops of a 'meta' run, as a comma separated list of OP[:WEIGHT]\n");
+    printf("\t\twhere the weights (1 by default) set the share of every op. Valid ops are\n" \
+           "\t\t'create' (an empty file), 'stat', 'open' (and close), 'rename' (to a new\n" \
+           "\t\tname, usually in another directory), 'unlink' and 'fsync-dir' (fsync of a\n" \
+           "\t\tdirectory of the tree). Defaults to create,stat,open,rename,unlink. An op\n" \
+           "\t\ton a file creates one instead when the thread has none left. Latencies\n" \
+           "\t\tare also reported for every op separately.\n");
+
+    printf("\t--dir-tree\n\t\tThe tree of directories a 'meta' or 'object' run creates under DEVICE, as\n");
+    printf("\t\tFANOUT[:DEPTH] (16:2 by default, 256 directories at the bottom level where\n");
+    printf("\t\tthe files go). The directories are left in place after the run.\n");
+
+    printf("\t--meta-files\n\t\tThe files every thread of a 'meta' or 'object' run creates before it\n");
+    printf("\t\tstarts (1024 by default). They and the files of the run are removed at the end.\n");
+
+    printf("\t--object-size\n\t\tSize of the objects of an 'object' run, as MIN[:MAX[:DIST]] where\n");
+    printf("\t\tDIST is 'uniform' (default), 'normal' or 'pow' and sizes take 'k', 'm' and\n" \
+           "\t\t'g'. Defaults to the block size. Reads take whole objects whatever their\n" \
+           "\t\tsize, writes replace an object (picked like reads, see --dist) with a new\n" \
+           "\t\tone of a size drawn from the distribution. Objects are %dm at most.\n",
+           MAX_OBJECT_SIZE / 1024 / 1024);
+
+    printf("\t--object-fsync\n\t\tFsync every object written before closing it.\n");
+
+    printf("\t--object-rename\n\t\tWrite every object to a temporary file next to it, then rename\n");
+    printf("\t\tit over the object, the way atomic replacements are committed.\n");
+    
+    printf("\t--pattern\n\t\tRun every op as a sequence of dependent steps on a block, the way\n");
+    printf("\t\tdatabases flush pages. Valid options are 'rmw' (read the block, then\n" \
+           "\t\twrite it back), 'journal' (write the block to the journal, sync, write it\n" \
+           "\t\tin place, sync) and 'rmw-journal' (a read, then the journal steps). The\n" \
+           "\t\tjournal takes the last %d blocks of the range, and writes aren't synced\n" \
+           "\t\tbut by the sync steps. Latencies are reported for whole sequences and for\n" \
+           "\t\tevery kind of step. Works with the stateful, stateless, paio and naio IO\n" \
+           "\t\ttypes, the async ones keep a sequence per queue slot.\n", JOURNAL_BLOCKS);
+
+    printf("\t--file-select\n\t\tHow ops pick the file of a file set.\n");
+    printf("\t\tValid options are 'uniform' (default), 'zipf' (the first files of the set\n" \
+           "\t\tare the most popular, 'zipf:S' sets the exponent, 1 by default) and 'rr' for\n" \
+           "\t\tround robin.\n");
+
+    printf("\t--files-per-thread\n\t\tGive every thread its own share of the files of a file set\n");
+    printf("\t\tinstead of letting all threads pick from the whole set.\n");
+
+    printf("\t--fd-cache\n\t\tThe number of files of a file set each thread keeps open, closing the\n");
+    printf("\t\tleast recently used one to open another (implies --local-fd). By default\n");
+    printf("\t\tevery file is opened up front and stays open. Not available with 'paio'.\n");
+
+    printf("\t--copy-file\n\t\tThe other file of a 'copyrange' run. Reads copy blocks from DEVICE\n");
+    printf("\t\tto the same offsets in this file, writes copy them from this file to DEVICE.\n");
     
     printf("\t-q, --queue-depth\n\t\tThe number of simultaneous AIO calls.\n");
     printf("\t\tValid only during 'paio', and 'naio' type of runs.\n");
@@ -88,14 +279,49 @@ void usage(const char *name) {
     printf("\t--eventfd\n\t\tUse eventfd for aio completion notification.\n");
     printf("\t\tValid only during 'naio' type of runs. Useful for measuring eventfd overhead.\n");
     
+    printf("\t--mmap-window\n\t\tSize of the sliding window to map at a time (the whole device is\n");
+    printf("\t\tmapped by default). Each thread maps its own window and remaps it when\n");
+    printf("\t\tan operation falls outside of it. Window size can be specified in units\n");
+    printf("\t\tother than bytes by appending 'k', 'm', 'g', or '%%'.\n");
+    printf("\t\tValid only during 'mmap' type of runs.\n");
+
+    printf("\t--mmap-populate\n\t\tPrefault the mapping (MAP_POPULATE) when it is created.\n");
+    printf("\t\tValid only during 'mmap' type of runs.\n");
+
+    printf("\t--madvise\n\t\tAdvice to pass to madvise for every mapping.\n");
+    printf("\t\tValid options are 'normal' (default), 'random', 'sequential', 'willneed',\n" \
+           "\t\tand 'hugepage' (for transparent huge pages).\n");
+    printf("\t\tValid only during 'mmap' type of runs.\n");
+
+    printf("\t--msync-async\n\t\tFlush written pages with MS_ASYNC instead of MS_SYNC.\n");
+    printf("\t\tValid only during unbuffered 'mmap' write runs.\n");
+
+    printf("\t--msync-batch\n\t\tThe number of writes to collect before flushing the pages they\n");
+    printf("\t\tdirtied, with an msync call per run of adjacent pages (1 by default, which\n");
+    printf("\t\tflushes every write). Flushes are timed apart from the writes.\n");
+    printf("\t\tValid only during unbuffered 'mmap' write runs.\n");
+    
     printf("\t-r, --direction\n\t\tDirection in which the operations are performed.\n");
     printf("\t\tValid options are 'formward' and 'backward'.\n" \
            "\t\tThis option is only applicable to sequential workloads.\n");
     
     printf("\t-o, --operation\n\t\tThe operation to be performed.\n");
     printf("\t\tValid options are 'read', 'write', and 'trim'.\n");
-    printf("\t\tNote that trim is only available on SSD devices\n");
-    printf("\t\tvia a stateful interface.\n");
+    printf("\t\tTrim is available via the stateful, stateless, paio and naio\n");
+    printf("\t\tinterfaces. There is no asynchronous trim, so paio and naio issue\n");
+    printf("\t\ttrims synchronously and ignore the queue depth.\n");
+
+    printf("\t--trim\n\t\tHow trim operations are performed.\n");
+    printf("\t\tValid options are 'discard' (BLKDISCARD, for SSD devices), 'secdiscard'\n" \
+           "\t\t(BLKSECDISCARD), 'zeroout' (BLKZEROOUT), 'punch' (fallocate punch hole,\n" \
+           "\t\tfor files) and 'zero' (fallocate zero range).\n" \
+           "\t\tDefaults to 'discard' for block devices and 'punch' for anything else.\n");
+
+    printf("\t--trim-batch\n\t\tQueue trims until this many bytes are pending, then merge adjacent\n");
+    printf("\t\tranges and issue one command per merged range (off by default).\n");
+    printf("\t\tThe latency of every issued command is reported separately.\n");
+    printf("\t\tBatch size can also be specified in units other than bytes by appending\n");
+    printf("\t\t'k', 'm', 'g', or '%%'.\n");
     
     printf("\t-p, --paged\n\t\tThis options turns off direct IO (which is on by default).\n");
     printf("\t-f, --buffered\n\t\tThis options turns off flushing (flushing is on by default).\n" \
@@ -118,6 +344,11 @@ void usage(const char *name) {
     printf("\t-n, --silent\n\t\tNon-interactive mode. Won't ask for write confirmation, and will\n"\
            "\t\tprint machine readable output in the following format:\n"\
            "\t\t[ops per second] [MB/sec] [min ops per second] [max ops per second] [standard deviation]\n");
+    printf("\t--format\n\t\tThe format results are printed in.\n");
+    printf("\t\tValid options are 'text' (default), 'json' (one object per line for each\n" \
+           "\t\tworkload) and 'csv' (a header line, then one row for each workload).\n" \
+           "\t\tBoth structured formats include the full workload configuration, the\n" \
+           "\t\tthroughput of every sample step, the latency percentiles and CPU usage.\n");
     printf("\t-j, --offset\n\t\tThe offset in the file to start operations from.\n");
     printf("\t\tBy default, this value is set to zero.\n");
     printf("\t\tOffset can also be specified in units other than bytes by appending 'k', 'm', 'g',\n");
@@ -131,12 +362,67 @@ void usage(const char *name) {
     printf("\t-g, --sample-step\n\t\tThe timestep between IOPS report samples (in milliseconds).\n");
     printf("\t\tDefaults to 1000ms. If set to zero, reports latency of every operation.\n");
 
+    printf("\t--percentiles\n\t\tComma separated list of the latency percentiles to report, 'max'\n");
+    printf("\t\tis the same as 100 (defaults to 50,60,70,80,90,95,99,99.5,99.9,99.99,99.999).\n");
+    printf("\t\tLatencies below 10us are kept exactly, larger ones with a relative error\n");
+    printf("\t\tof at most 0.05%%.\n");
+
+    printf("\t--latency-capacity\n\t\tThe number of per-operation latencies kept between two reports\n");
+    printf("\t\twhen the sample step is zero (1000000 by default). Memory use doesn't\n");
+    printf("\t\tgrow past this, latencies of operations that don't fit are left out\n");
+    printf("\t\tof the output (but not of the statistics) and counted.\n");
+
+    printf("\t--latency-capture\n\t\tWhat happens once the latency capacity is reached.\n");
+    printf("\t\tValid options are 'reservoir' (keep a uniform sample, default) and 'ring'\n");
+    printf("\t\t(keep the most recent latencies).\n");
+
     printf("\t-z, --pause\n\t\tThe timestep to wait between a completion of an operation and execution\n");
     printf("\t\tof the next operation in microseconds. Defaults to zero.\n");    
 
+    printf("\t--perf\n\t\tCount cycles, instructions, context switches, page faults and syscalls\n");
+    printf("\t\tof every benchmark thread with perf_event_open and report them per op.\n");
+    printf("\t\tCounters the kernel doesn't permit are reported as n/a (syscalls need\n");
+    printf("\t\taccess to the raw_syscalls tracepoint). Like the CPU time, this doesn't\n");
+    printf("\t\tinclude the helper threads glibc uses for 'paio'.\n");
+
+    printf("\t--device-stats\n\t\tSample the statistics of the disk behind DEVICE (/sys/block/<disk>/stat,\n");
+    printf("\t\tthe whole disk for a partition or a file) and report what the device did\n");
+    printf("\t\tnext to the application numbers. With --output, every line gets these\n");
+    printf("\t\tcolumns appended: device reads/sec, writes/sec, read merges/sec, write\n");
+    printf("\t\tmerges/sec, read MB/sec, write MB/sec, average queue size, utilization\n");
+    printf("\t\t(%%), read await (ms) and write await (ms).\n");
+
+    printf("\t--clock\n\t\tThe clock used to time operations.\n");
+    printf("\t\tValid options are 'monotonic' (clock_gettime(CLOCK_MONOTONIC), default) and\n" \
+           "\t\t'tsc' (the invariant time stamp counter, calibrated against the monotonic\n" \
+           "\t\tclock at startup). Reading the TSC costs a fraction of clock_gettime, which\n" \
+           "\t\tmatters for operations that complete in a few hundred nanoseconds. If the\n" \
+           "\t\tTSC isn't invariant or doesn't calibrate consistently, rebench warns and\n" \
+           "\t\tfalls back to the monotonic clock. The clock is shared by all workloads.\n" \
+           "\t\tUse rebench-clock to compare the overhead and resolution of both.\n");
+
+    printf("\t--no-calibrate\n\t\tSkip the harness calibration. By default every workload is first run\n");
+    printf("\t\tfor %dms with the 'null' IO type (same threads, workload and stats\n", CALIBRATION_MS);
+    printf("\t\tsettings, no IO) and the resulting ceiling is reported next to the results,\n");
+    printf("\t\twith a warning when the workload gets close to it.\n");
+
     printf("\t--drop-caches\n\t\tAsks the kernel to drop the cache before running the benchmark.\n");
 
     printf("\t--output\n\t\tA file name to write detailed data output to at each sample step.\n");
+    printf("\t\tWith --phase, every line ends with the name of the phase.\n");
+
+    printf("\t--trace\n\t\tA file name to record a binary trace of every operation to (start and end\n");
+    printf("\t\ttime, offset, size, operation and thread). The steps of a --pattern are recorded\n");
+    printf("\t\tone by one, sync steps as \"sync\". Use rebench-trace to convert it to text.\n");
+
+    printf("\t--histogram\n\t\tA file name to write the compact latency histogram to, at each sample\n");
+    printf("\t\tstep and for the whole run. Use rebench-merge to combine histograms of\n");
+    printf("\t\tmany runs or hosts.\n");
+
+    printf("\t--metrics\n\t\tServe the stats of the last sample step of every workload in the\n");
+    printf("\t\tPrometheus text format over HTTP while the benchmark runs. Takes a TCP port\n");
+    printf("\t\t(bound to localhost) or the path of a Unix socket. Not available when\n");
+    printf("\t\tthe sample step is zero.\n");
     
     exit(0);
 }
@@ -181,6 +467,113 @@ void parse_duration(char *duration, workload_config_t *config) {
     }
 }
 
+void parse_warmup(char *warmup, workload_config_t *config) {
+    if(!warmup[0])
+        return;
+
+    int len = strlen(warmup);
+    config->warmup = parse_size(warmup, config->device_length);
+    config->warmup_unit = dut_space;
+    if(warmup[len - 1] != '%' &&
+       warmup[len - 1] != 'k' &&
+       warmup[len - 1] != 'm' &&
+       warmup[len - 1] != 'g')
+    {
+        config->warmup_unit = dut_time;
+    }
+    check("Invalid warmup", config->warmup < 0);
+}
+
+void parse_phase(char *phase, workload_config_t *config) {
+    check("Too many phases", config->phase_count == MAX_PHASES);
+    phase_t *res = &config->phases[config->phase_count++];
+
+    char *name_end = strchr(phase, ':');
+    check("Invalid phase (use NAME:SECS[:RATE|idle])", name_end == NULL || name_end == phase);
+    check("Phase name is too long", name_end - phase >= PHASE_NAME_LENGTH);
+    strncpy(res->name, phase, name_end - phase);
+    res->name[name_end - phase] = 0;
+
+    char *end;
+    res->duration = strtoll(name_end + 1, &end, 10);
+    check("Invalid phase duration", end == name_end + 1 || res->duration < 1);
+    res->rate = 0;
+    if(*end == 0)
+        return;
+    check("Invalid phase (use NAME:SECS[:RATE|idle])", *end != ':');
+    if(strcmp(end + 1, "idle") == 0) {
+        res->rate = PHASE_IDLE;
+    } else {
+        char *rate = end + 1;
+        res->rate = strtol(rate, &end, 10);
+        check("Invalid phase rate", end == rate || *end != 0 || res->rate < 1);
+    }
+}
+
+void parse_meta_ops(char *ops, workload_config_t *config) {
+    for(int i = 0; i < mop_count; i++)
+        config->meta_weights[i] = 0;
+    for(char *op = strtok(ops, ","); op != NULL; op = strtok(NULL, ",")) {
+        int weight = 1;
+        char *colon = strchr(op, ':');
+        if(colon != NULL) {
+            *colon = 0;
+            char *end;
+            weight = strtol(colon + 1, &end, 10);
+            check("Invalid metadata op weight", end == colon + 1 || *end != 0 || weight < 1);
+        }
+        int i = 0;
+        while(i < mop_count && strcmp(op, meta_op_name((meta_op_t)i)) != 0)
+            i++;
+        check("Invalid metadata op", i == mop_count);
+        config->meta_weights[i] += weight;
+    }
+    int total = 0;
+    for(int i = 0; i < mop_count; i++)
+        total += config->meta_weights[i];
+    check("Please give at least one metadata op", total == 0);
+}
+
+void parse_dir_tree(char *tree, workload_config_t *config) {
+    char *end;
+    config->dir_fanout = strtol(tree, &end, 10);
+    check("Invalid directory fanout", end == tree || config->dir_fanout < 1);
+    if(*end == 0)
+        return;
+    check("Invalid directory tree (use FANOUT[:DEPTH])", *end != ':');
+    char *depth = end + 1;
+    config->dir_depth = strtol(depth, &end, 10);
+    check("Invalid directory depth", end == depth || *end != 0 || config->dir_depth < 1);
+}
+
+void parse_object_size(char *size, workload_config_t *config) {
+    char *max = strchr(size, ':');
+    if(max != NULL)
+        *max++ = 0;
+    config->object_min_size = parse_size(size, 0);
+    config->object_max_size = config->object_min_size;
+    config->object_size_dist = rdt_const;
+    check("Invalid object size", config->object_min_size < 1 || config->object_min_size > MAX_OBJECT_SIZE);
+    if(max == NULL)
+        return;
+
+    char *dist = strchr(max, ':');
+    if(dist != NULL)
+        *dist++ = 0;
+    config->object_max_size = parse_size(max, 0);
+    check("Invalid maximum object size",
+          config->object_max_size < config->object_min_size || config->object_max_size > MAX_OBJECT_SIZE);
+    config->object_size_dist = rdt_uniform;
+    if(dist == NULL || strcmp(dist, "uniform") == 0)
+        return;
+    else if(strcmp(dist, "normal") == 0)
+        config->object_size_dist = rdt_normal;
+    else if(strcmp(dist, "pow") == 0)
+        config->object_size_dist = rdt_power;
+    else
+        check("Invalid object size distribution", 1);
+}
+
 void parse_length(char *length, workload_config_t *config) {
     config->length = parse_size(length, config->device_length);
 }
@@ -197,15 +590,32 @@ void parse_stride(char *length, workload_config_t *config) {
     config->stride = parse_size(length, config->device_length);
 }
 
+void parse_mmap_window(char *length, workload_config_t *config) {
+    config->mmap_window = parse_size(length, config->device_length);
+}
+
+void parse_trim_batch(char *length, workload_config_t *config) {
+    config->trim_batch = parse_size(length, config->device_length);
+}
+
 void parse_options(int argc, char *argv[], workload_config_t *config) {
     char duration_buf[256];
     duration_buf[0] = 0;
+    char warmup_buf[256];
+    warmup_buf[0] = 0;
     init_workload_config(config);
     optind = 1; // reinit getopt
     char *length_arg = NULL;
     char *offset_arg = NULL;
     char *block_size_arg = NULL;
     char *stride_arg = NULL;
+    char *mmap_window_arg = NULL;
+    char *trim_batch_arg = NULL;
+    char *precondition_bs_arg = NULL;
+    char *meta_ops_arg = NULL;
+    char *dir_tree_arg = NULL;
+    bool meta_files_set = false;
+    char *object_size_arg = NULL;
     while(1)
     {
         struct option long_options[] =
@@ -231,9 +641,47 @@ void parse_options(int argc, char *argv[], workload_config_t *config) {
                 {"append", no_argument, &config->append_only, 1},
                 {"local-fd", no_argument, &config->local_fd, 1},
                 {"silent", no_argument, &config->silent, 1},
+                {"format", required_argument, 0, FORMAT_FLAG},
+                {"percentiles", required_argument, 0, PERCENTILES_FLAG},
                 {"drop-caches", no_argument, &config->drop_caches, 1},
                 {"output", required_argument, 0, OUTPUT_FLAG},
                 {"eventfd", no_argument, &config->use_eventfd, 1},		
+                {"perf", no_argument, &config->perf, 1},
+                {"device-stats", no_argument, &config->device_stats, 1},
+                {"clock", required_argument, 0, CLOCK_FLAG},
+                {"no-calibrate", no_argument, &config->calibrate, 0},
+                {"warmup", required_argument, 0, WARMUP_FLAG},
+                {"steady-state", required_argument, 0, STEADY_STATE_FLAG},
+                {"phase", required_argument, 0, PHASE_FLAG},
+                {"file-select", required_argument, 0, FILE_SELECT_FLAG},
+                {"files-per-thread", no_argument, &config->files_per_thread, 1},
+                {"fd-cache", required_argument, 0, FD_CACHE_FLAG},
+                {"meta-ops", required_argument, 0, META_OPS_FLAG},
+                {"dir-tree", required_argument, 0, DIR_TREE_FLAG},
+                {"meta-files", required_argument, 0, META_FILES_FLAG},
+                {"object-size", required_argument, 0, OBJECT_SIZE_FLAG},
+                {"object-fsync", no_argument, 0, OBJECT_FSYNC_FLAG},
+                {"object-rename", no_argument, 0, OBJECT_RENAME_FLAG},
+                {"pattern", required_argument, 0, PATTERN_FLAG},
+                {"repeat", required_argument, 0, REPEAT_FLAG},
+                {"baseline", required_argument, 0, BASELINE_FLAG},
+                {"precondition", required_argument, 0, PRECONDITION_FLAG},
+                {"precondition-bs", required_argument, 0, PRECONDITION_BS_FLAG},
+                {"precondition-time", required_argument, 0, PRECONDITION_TIME_FLAG},
+                {"precondition-state", required_argument, 0, PRECONDITION_STATE_FLAG},
+                {"mmap-window", required_argument, 0, MMAP_WINDOW_FLAG},
+                {"mmap-populate", no_argument, &config->mmap_populate, 1},
+                {"madvise", required_argument, 0, MADVISE_FLAG},
+                {"msync-async", no_argument, &config->msync_async, 1},
+                {"msync-batch", required_argument, 0, MSYNC_BATCH_FLAG},
+                {"copy-file", required_argument, 0, COPY_FILE_FLAG},
+                {"trim", required_argument, 0, TRIM_MODE_FLAG},
+                {"trim-batch", required_argument, 0, TRIM_BATCH_FLAG},
+                {"trace", required_argument, 0, TRACE_FLAG},
+                {"histogram", required_argument, 0, HISTOGRAM_FLAG},
+                {"metrics", required_argument, 0, METRICS_FLAG},
+                {"latency-capacity", required_argument, 0, LATENCY_CAPACITY_FLAG},
+                {"latency-capture", required_argument, 0, LATENCY_CAPTURE_FLAG},
                 {0, 0, 0, 0}
             };
 
@@ -316,6 +764,18 @@ void parse_options(int argc, char *argv[], workload_config_t *config) {
                 config->io_type = iot_naio;
             else if(strcmp(optarg, "mmap") == 0)
                 config->io_type = iot_mmap;
+            else if(strcmp(optarg, "sendfile") == 0)
+                config->io_type = iot_sendfile;
+            else if(strcmp(optarg, "splice") == 0)
+                config->io_type = iot_splice;
+            else if(strcmp(optarg, "copyrange") == 0)
+                config->io_type = iot_copy_range;
+            else if(strcmp(optarg, "null") == 0)
+                config->io_type = iot_null;
+            else if(strcmp(optarg, "meta") == 0)
+                config->io_type = iot_meta;
+            else if(strcmp(optarg, "object") == 0)
+                config->io_type = iot_object;
             else
                 check("Invalid IO type", 1);
             break;
@@ -373,6 +833,210 @@ void parse_options(int argc, char *argv[], workload_config_t *config) {
             strncpy(config->output_file, optarg, DEVICE_NAME_LENGTH);
             break;
 
+        case MMAP_WINDOW_FLAG:
+            mmap_window_arg = optarg;
+            break;
+
+        case TRIM_MODE_FLAG:
+            if(strcmp(optarg, "discard") == 0)
+                config->trim_mode = trm_discard;
+            else if(strcmp(optarg, "punch") == 0)
+                config->trim_mode = trm_punch_hole;
+            else if(strcmp(optarg, "zero") == 0)
+                config->trim_mode = trm_zero_range;
+            else if(strcmp(optarg, "zeroout") == 0)
+                config->trim_mode = trm_zero_out;
+            else if(strcmp(optarg, "secdiscard") == 0)
+                config->trim_mode = trm_secure_discard;
+            else
+                check("Invalid trim mode", 1);
+            break;
+
+        case LATENCY_CAPACITY_FLAG:
+            config->latency_capacity = atoi(optarg);
+            break;
+
+        case LATENCY_CAPTURE_FLAG:
+            if(strcmp(optarg, "reservoir") == 0)
+                config->latency_capture = lct_reservoir;
+            else if(strcmp(optarg, "ring") == 0)
+                config->latency_capture = lct_ring;
+            else
+                check("Invalid latency capture mode", 1);
+            break;
+
+        case PERCENTILES_FLAG:
+            config->percentile_mark_count = parse_percentile_marks(optarg, config->percentile_marks, MAX_PERCENTILE_MARKS);
+            check("Invalid percentiles (use a comma separated list of values in (0, 100] or 'max')",
+                  config->percentile_mark_count == -1);
+            break;
+
+        case FORMAT_FLAG:
+            if(strcmp(optarg, "text") == 0)
+                config->format = ofm_text;
+            else if(strcmp(optarg, "json") == 0)
+                config->format = ofm_json;
+            else if(strcmp(optarg, "csv") == 0)
+                config->format = ofm_csv;
+            else
+                check("Invalid output format", 1);
+            break;
+
+        case CLOCK_FLAG:
+            if(strcmp(optarg, "monotonic") == 0)
+                config->clock_source = cls_monotonic;
+            else if(strcmp(optarg, "tsc") == 0)
+                config->clock_source = cls_tsc;
+            else
+                check("Invalid clock source", 1);
+            break;
+
+        case WARMUP_FLAG:
+            strncpy(warmup_buf, optarg, sizeof(warmup_buf));
+            warmup_buf[sizeof(warmup_buf) - 1] = 0;
+            break;
+
+        case STEADY_STATE_FLAG:
+            config->steady_state_rounds = atoi(optarg);
+            check("Please use a steady state window of at least 2 sample steps",
+                  config->steady_state_rounds < 2);
+            break;
+
+        case FILE_SELECT_FLAG:
+            if(strcmp(optarg, "uniform") == 0)
+                config->file_select = fsl_uniform;
+            else if(strcmp(optarg, "rr") == 0)
+                config->file_select = fsl_round_robin;
+            else if(strncmp(optarg, "zipf", 4) == 0 && (optarg[4] == 0 || optarg[4] == ':')) {
+                config->file_select = fsl_zipf;
+                if(optarg[4] == ':')
+                    config->zipf_exponent = atof(optarg + 5);
+                check("Invalid zipf exponent", config->zipf_exponent <= 0);
+            }
+            else
+                check("Invalid file selection", 1);
+            break;
+
+        case FD_CACHE_FLAG:
+            config->fd_cache = atoi(optarg);
+            check("Please keep at least one file open", config->fd_cache < 1);
+            break;
+
+        case META_OPS_FLAG:
+            meta_ops_arg = optarg;
+            parse_meta_ops(optarg, config);
+            break;
+
+        case DIR_TREE_FLAG:
+            dir_tree_arg = optarg;
+            parse_dir_tree(optarg, config);
+            break;
+
+        case META_FILES_FLAG:
+            config->meta_files = atoi(optarg);
+            check("Invalid number of metadata files", config->meta_files < 0);
+            meta_files_set = true;
+            break;
+
+        case OBJECT_SIZE_FLAG:
+            object_size_arg = optarg;
+            break;
+
+        case OBJECT_FSYNC_FLAG:
+            config->object_fsync = 1;
+            break;
+
+        case OBJECT_RENAME_FLAG:
+            config->object_rename = 1;
+            break;
+
+        case PATTERN_FLAG:
+            if(strcmp(optarg, "rmw") == 0)
+                config->pattern = pat_rmw;
+            else if(strcmp(optarg, "journal") == 0)
+                config->pattern = pat_journal;
+            else if(strcmp(optarg, "rmw-journal") == 0)
+                config->pattern = pat_rmw_journal;
+            else
+                check("Invalid pattern", 1);
+            break;
+
+        case REPEAT_FLAG:
+            config->repeat = atoi(optarg);
+            check("Please repeat the runs at least once", config->repeat < 1);
+            break;
+
+        case BASELINE_FLAG:
+            strncpy(config->baseline_file, optarg, DEVICE_NAME_LENGTH);
+            config->baseline_file[DEVICE_NAME_LENGTH - 1] = 0;
+            break;
+
+        case PHASE_FLAG:
+            parse_phase(optarg, config);
+            break;
+
+        case PRECONDITION_FLAG:
+            config->precondition_passes = atoi(optarg);
+            check("Invalid number of preconditioning passes", config->precondition_passes < 0);
+            break;
+
+        case PRECONDITION_BS_FLAG:
+            precondition_bs_arg = optarg;
+            break;
+
+        case PRECONDITION_TIME_FLAG:
+            config->precondition_time = atoll(optarg);
+            check("Please precondition for at least a second", config->precondition_time < 1);
+            break;
+
+        case PRECONDITION_STATE_FLAG:
+            strncpy(config->precondition_state, optarg, DEVICE_NAME_LENGTH);
+            config->precondition_state[DEVICE_NAME_LENGTH - 1] = 0;
+            break;
+
+        case METRICS_FLAG:
+            strncpy(config->metrics_address, optarg, DEVICE_NAME_LENGTH);
+            config->metrics_address[DEVICE_NAME_LENGTH - 1] = 0;
+            break;
+
+        case HISTOGRAM_FLAG:
+            strncpy(config->histogram_file, optarg, DEVICE_NAME_LENGTH);
+            config->histogram_file[DEVICE_NAME_LENGTH - 1] = 0;
+            break;
+
+        case TRACE_FLAG:
+            strncpy(config->trace_file, optarg, DEVICE_NAME_LENGTH);
+            config->trace_file[DEVICE_NAME_LENGTH - 1] = 0;
+            break;
+
+        case TRIM_BATCH_FLAG:
+            trim_batch_arg = optarg;
+            break;
+
+        case COPY_FILE_FLAG:
+            strncpy(config->copy_file, optarg, DEVICE_NAME_LENGTH);
+            config->copy_file[DEVICE_NAME_LENGTH - 1] = 0;
+            break;
+
+        case MSYNC_BATCH_FLAG:
+            config->msync_batch = atoi(optarg);
+            break;
+
+        case MADVISE_FLAG:
+            if(strcmp(optarg, "normal") == 0)
+                config->mmap_advice = mad_normal;
+            else if(strcmp(optarg, "random") == 0)
+                config->mmap_advice = mad_random;
+            else if(strcmp(optarg, "sequential") == 0)
+                config->mmap_advice = mad_sequential;
+            else if(strcmp(optarg, "willneed") == 0)
+                config->mmap_advice = mad_willneed;
+            else if(strcmp(optarg, "hugepage") == 0)
+                config->mmap_advice = mad_hugepage;
+            else
+                check("Invalid madvise mode", 1);
+            break;
+
         case '?':
             /* getopt_long already printed an error message. */
             usage(argv[0]);
@@ -383,6 +1047,11 @@ void parse_options(int argc, char *argv[], workload_config_t *config) {
         }
     }
 
+    // The engines of a directory tree open the directory, and objects
+    // have sizes direct IO wouldn't take
+    if(uses_dir_tree(config))
+        config->direct_io = 0;
+
     if(config->pause_interval != 0
        && (config->io_type == iot_paio || config->io_type == iot_naio)) {
         check("Pauses aren't implemented for paio and naio backends", 1);
@@ -416,6 +1085,9 @@ void parse_options(int argc, char *argv[], workload_config_t *config) {
     if(config->threads < 1)
         check("Please use at least one thread", 1);
 
+    if(config->latency_capacity < 1)
+        check("Please keep at least one latency", 1);
+
     if(config->direct_io && config->io_type == iot_mmap)
         check("Can't use mmap with direct IO (use --paged)", 1);
 
@@ -427,7 +1099,9 @@ void parse_options(int argc, char *argv[], workload_config_t *config) {
         config->io_type == iot_mmap)
         check("Memory mapping isn't implemented where remapping might be required", 1);
 
-    if(config->operation == op_write && !config->silent) {
+    if((config->operation == op_write || uses_dir_tree(config) || config->pattern != pat_none ||
+        config->precondition_passes != -1) &&
+       !config->silent) {
         while(true) {
             printf("Are you sure you want to write to %s [y/N]? ", config->device);
             int response = getc(stdin);
@@ -453,7 +1127,106 @@ void parse_options(int argc, char *argv[], workload_config_t *config) {
     check("Eventfd is only relevant for naio workloads",
           config->use_eventfd == 1 && config->io_type != iot_naio);
 
-    config->device_length = get_device_length(config->device);
+    check("Mapping options are only relevant for mmap workloads",
+          (mmap_window_arg || config->mmap_populate || config->mmap_advice != mad_normal)
+          && config->io_type != iot_mmap);
+
+    check("Msync options are only relevant for unbuffered mmap writes",
+          (config->msync_async || config->msync_batch != 1)
+          && (config->io_type != iot_mmap || config->operation != op_write || config->buffered));
+
+    check("Msync batch must be at least one write", config->msync_batch < 1);
+
+    check("Sendfile and splice only support read operations",
+          (config->io_type == iot_sendfile || config->io_type == iot_splice)
+          && config->operation != op_read);
+
+    check("Trim isn't implemented for this IO interface type (try the stateful or stateless IO interface)",
+          config->operation == op_trim &&
+          config->io_type != iot_stateful && config->io_type != iot_stateless &&
+          config->io_type != iot_paio && config->io_type != iot_naio &&
+          config->io_type != iot_null);
+
+    check("Patterns are only implemented for the stateful, stateless, paio and naio IO types",
+          config->pattern != pat_none &&
+          config->io_type != iot_stateful && config->io_type != iot_stateless &&
+          config->io_type != iot_paio && config->io_type != iot_naio);
+    check("Patterns take their ops from --pattern (drop --operation)",
+          config->pattern != pat_none && config->operation != op_read);
+    check("Append-only writes don't go to the blocks of a pattern",
+          config->pattern != pat_none && config->append_only);
+
+    check("Trim mode is only relevant for trim workloads",
+          config->trim_mode != trm_auto && config->operation != op_trim);
+
+    check("Trim batch is only relevant for trim workloads",
+          trim_batch_arg && config->operation != op_trim);
+
+    check("Copyrange needs the other file to copy with (use --copy-file)",
+          config->io_type == iot_copy_range && config->copy_file[0] == 0);
+
+    check("Device stats need a non-zero sample step",
+          config->device_stats && config->sample_step == 0);
+
+    check("Metrics need a non-zero sample step",
+          config->metrics_address[0] != 0 && config->sample_step == 0);
+
+    check("Copy file is only relevant for copyrange workloads",
+          config->copy_file[0] != 0 && config->io_type != iot_copy_range);
+
+    check("Metadata ops are only relevant for meta workloads",
+          meta_ops_arg && config->io_type != iot_meta);
+    check("Directory tree options are only relevant for meta and object workloads",
+          (dir_tree_arg || meta_files_set) && !uses_dir_tree(config));
+    check("Object options are only relevant for object workloads",
+          (object_size_arg || config->object_fsync || config->object_rename) && config->io_type != iot_object);
+    check("Meta workloads take their ops from --meta-ops (drop --operation)",
+          config->io_type == iot_meta && config->operation != op_read);
+    if(config->io_type == iot_object) {
+        check("Object workloads read or write objects", config->operation == op_trim);
+        check("Object workloads need at least one object per thread", config->meta_files < 1);
+        check("Object commit options are only relevant for writes",
+              (config->object_fsync || config->object_rename) && config->operation != op_write);
+    }
+    if(uses_dir_tree(config)) {
+        check("Meta and object workloads need a directory to build the tree in", !is_directory(config->device));
+        check("Cannot drop the caches of a directory tree", config->drop_caches);
+        check("Cannot precondition a directory tree", config->precondition_passes != -1);
+        long long leaves = 1;
+        for(int i = 0; i < config->dir_depth && leaves <= MAX_DIR_TREE_LEAVES; i++)
+            leaves *= config->dir_fanout;
+        check("The directory tree is too large", leaves > MAX_DIR_TREE_LEAVES);
+    }
+
+    config->file_set = !uses_dir_tree(config) && is_file_set(config->device);
+    check("File selection options need a file set",
+          !config->file_set &&
+          (config->file_select != fsl_uniform || config->files_per_thread || config->fd_cache != 0));
+    check("Mmap doesn't work on file sets", config->file_set && config->io_type == iot_mmap);
+    check("Trim batches can't span the files of a file set", config->file_set && trim_batch_arg);
+    check("Cannot precondition a file set", config->file_set && config->precondition_passes != -1);
+    check("Patterns don't run on file sets", config->file_set && config->pattern != pat_none);
+    check("The fd cache can't close files under POSIX AIO requests (use naio)",
+          config->fd_cache != 0 && config->io_type == iot_paio);
+    // The cache is per thread
+    if(config->fd_cache != 0)
+        config->local_fd = 1;
+
+    if(config->operation == op_trim && config->trim_mode == trm_auto) {
+        if(!config->file_set && is_block_device(config->device))
+            config->trim_mode = trm_discard;
+        else
+            config->trim_mode = trm_punch_hole;
+    }
+
+    // A file set is as long as its largest file, a directory tree has no
+    // data at all
+    if(uses_dir_tree(config))
+        config->device_length = 0;
+    else if(config->file_set)
+        config->device_length = get_file_set_length(config->device);
+    else
+        config->device_length = get_device_length(config->device);
 
     if(length_arg) {
         parse_length(length_arg, config);
@@ -464,9 +1237,30 @@ void parse_options(int argc, char *argv[], workload_config_t *config) {
     if(block_size_arg) {
         parse_block_size(block_size_arg, config);
     }
+    if(object_size_arg) {
+        parse_object_size(object_size_arg, config);
+    } else if(config->io_type == iot_object) {
+        config->object_min_size = config->block_size;
+        config->object_max_size = config->block_size;
+        check("Objects are too large (use --object-size)", config->block_size > MAX_OBJECT_SIZE);
+    }
     if(stride_arg) {
         parse_stride(stride_arg, config);
     }
+    if(trim_batch_arg) {
+        parse_trim_batch(trim_batch_arg, config);
+        check("Trim batch must be at least the size of a block",
+              config->trim_batch < config->block_size);
+    }
+    if(precondition_bs_arg) {
+        config->precondition_block_size = parse_size(precondition_bs_arg, config->device_length);
+        check("Invalid preconditioning block size", config->precondition_block_size <= 0);
+    }
+    if(mmap_window_arg) {
+        parse_mmap_window(mmap_window_arg, config);
+        check("Mmap window must be at least the size of a block",
+              config->mmap_window < config->block_size);
+    }
     
     // Set the length
     if(config->length == 0) {
@@ -477,11 +1271,103 @@ void parse_options(int argc, char *argv[], workload_config_t *config) {
     if(config->offset + config->length > config->device_length) {
         config->length = config->device_length - config->offset;
     }
+    // The journal comes out of the end of the range, ops keep to the rest
+    if(config->pattern == pat_journal || config->pattern == pat_rmw_journal) {
+        off64_t journal_length = (off64_t)JOURNAL_BLOCKS * config->block_size;
+        check("The range is too small for the journal of the pattern",
+              config->length < journal_length + config->block_size);
+        config->length -= journal_length;
+        config->journal_offset = config->offset + config->length;
+    }
 
     parse_duration(duration_buf, config);
     if(config->duration_unit == dut_interactive && config->threads > 1) {
         check("Cannot run in interactive mode with multiple threads", 1);
     }
+    if(config->duration_unit == dut_interactive && config->format != ofm_text) {
+        check("Cannot print structured results in interactive mode", 1);
+    }
+
+    parse_warmup(warmup_buf, config);
+    check("Cannot warm up in interactive mode",
+          config->warmup != 0 && config->duration_unit == dut_interactive);
+    check("Meta and object workloads run for a time, not an amount of data",
+          uses_dir_tree(config) &&
+          (config->duration_unit == dut_space || (config->warmup != 0 && config->warmup_unit == dut_space)));
+    check("Steady state detection needs a non-zero sample step",
+          config->steady_state_rounds != 0 && config->sample_step == 0);
+    check("Cannot detect steady state in interactive mode",
+          config->steady_state_rounds != 0 && config->duration_unit == dut_interactive);
+    check("Preconditioning options need --precondition",
+          config->precondition_passes == -1 &&
+          (precondition_bs_arg || config->precondition_state[0] != 0 || config->precondition_time != 1800));
+
+    check("Cannot repeat interactive runs",
+          config->repeat > 1 && config->duration_unit == dut_interactive);
+    check("Comparing with a baseline needs --repeat of at least 2",
+          config->baseline_file[0] != 0 && config->repeat < 2);
+
+    if(config->phase_count != 0) {
+        check("Phases set the duration of the run (drop --duration)", duration_buf[0] != 0);
+        check("Cannot combine phases with steady state detection", config->steady_state_rounds != 0);
+        config->duration = 0;
+        for(int i = 0; i < config->phase_count; i++)
+            config->duration += config->phases[i].duration;
+    }
+}
+
+int phase_at(workload_config_t *config, double secs) {
+    int phase = 0;
+    while(phase < config->phase_count - 1 && secs >= config->phases[phase].duration) {
+        secs -= config->phases[phase].duration;
+        phase++;
+    }
+    return phase;
+}
+
+const char* io_type_name(io_type_t io_type) {
+    const char *io_types[] = { "stateful", "stateless", "paio", "naio", "mmap", "sendfile", "splice", "copyrange", "null",
+                               "meta", "object" };
+    return io_types[io_type];
+}
+
+int uses_dir_tree(workload_config_t *config) {
+    return config->io_type == iot_meta || config->io_type == iot_object;
+}
+
+const char* pattern_name(pattern_t pattern) {
+    const char *patterns[] = { "none", "rmw", "journal", "rmw-journal" };
+    return patterns[pattern];
+}
+
+const char* pattern_step_name(pattern_step_t step) {
+    const char *steps[] = { "read", "write", "journal", "sync" };
+    return steps[step];
+}
+
+int get_pattern_steps(pattern_t pattern, pattern_step_t *steps) {
+    int count = 0;
+    if(pattern == pat_rmw || pattern == pat_rmw_journal)
+        steps[count++] = pst_read;
+    if(pattern == pat_journal || pattern == pat_rmw_journal) {
+        steps[count++] = pst_journal;
+        steps[count++] = pst_sync;
+        steps[count++] = pst_write;
+        steps[count++] = pst_sync;
+    } else {
+        steps[count++] = pst_write;
+    }
+    return count;
+}
+
+const char* operation_name(operation_t operation) {
+    const char *operations[] = { "read", "write", "trim" };
+    return operations[operation];
+}
+
+const char* meta_op_name(meta_op_t op) {
+    const char *ops[] = { "create", "stat", "open", "rename", "unlink", "fsync-dir" };
+    return ops[op];
 }
 
 void print_size(off64_t size) {
@@ -502,55 +1388,48 @@ void print_size(off64_t size) {
     }
 }
 
-void print_status(off64_t length, workload_config_t *config) {
-    if(config->silent)
-        return;
-    
-    printf("Benchmarking results for [%s] (", config->device);
-    print_size(length);
-    printf(")\n");
-        
-    printf("[duration: ");
-    if(config->duration_unit == dut_time) {
-        printf("%llds, ", config->duration);
-    } else if(config->duration_unit == dut_space) {
-        print_size(config->duration);
-        printf(", ");
+// Operation, block and offset settings of data workloads
+static void print_operation_status(workload_config_t *config) {
+    if(config->pattern != pat_none) {
+        printf("pattern: %s, ", pattern_name(config->pattern));
+        if(config->pattern == pat_journal || config->pattern == pat_rmw_journal) {
+            printf("journal at: ");
+            print_size(config->journal_offset);
+            printf(", ");
+        }
     } else {
-        printf("interactive, ");
-    }
-
-    if(config->offset != 0) {
-        printf("offset: ");
-        print_size(config->offset);
-        printf(", ");
-    }
-    if(config->length != config->device_length) {
-        printf("length: ");
-        print_size(config->length);
-        printf(", ");
+        printf("operation: ");
+        if(config->operation == op_write)
+            printf("write, ");
+        else if(config->operation == op_read)
+            printf("read, ");
+        else if(config->operation == op_trim)
+            printf("trim, ");
+        else
+            check("Unknown operation", 1);
     }
 
-    printf("threads: %d, ", config->threads);
-
-    if(config->threads > 1) {
-        printf("fd: ");
-        if(config->local_fd)
-            printf("local, ");
+    if(config->operation == op_trim) {
+        printf("trim: ");
+        if(config->trim_mode == trm_discard)
+            printf("discard, ");
+        else if(config->trim_mode == trm_punch_hole)
+            printf("punch hole, ");
+        else if(config->trim_mode == trm_zero_range)
+            printf("zero range, ");
+        else if(config->trim_mode == trm_zero_out)
+            printf("zero out, ");
+        else if(config->trim_mode == trm_secure_discard)
+            printf("secure discard, ");
         else
-            printf("shared, ");
+            check("Invalid trim mode", 1);
+        if(config->trim_batch != 0) {
+            printf("trim batch: ");
+            print_size(config->trim_batch);
+            printf(", ");
+        }
     }
     
-    printf("operation: ");
-    if(config->operation == op_write)
-        printf("write, ");
-    else if(config->operation == op_read)
-        printf("read, ");
-    else if(config->operation == op_trim)
-        printf("trim, ");
-    else
-        check("Unknown operation", 1);
-    
     if(config->operation == op_write) {
         printf("buffering: ");
         if(config->buffered)
@@ -587,7 +1466,88 @@ void print_status(off64_t length, workload_config_t *config) {
         if(config->dist == rdt_normal || config->dist == rdt_power)
             printf("sigma: %d, ", config->sigma);
     }
+}
+
+static void print_meta_status(workload_config_t *config) {
+    printf("metadata ops: ");
+    for(int i = 0, first = 1; i < mop_count; i++) {
+        if(config->meta_weights[i] == 0)
+            continue;
+        printf("%s%s:%d", first ? "" : ",", meta_op_name((meta_op_t)i), config->meta_weights[i]);
+        first = 0;
+    }
+    printf(", directory tree: %d:%d, files per thread: %d, ",
+           config->dir_fanout, config->dir_depth, config->meta_files);
+}
+
+static void print_object_status(workload_config_t *config) {
+    const char *dists[] = { "const", "uniform", "normal", "pow" };
+    printf("objects: %s, object size: ", operation_name(config->operation));
+    print_size(config->object_min_size);
+    if(config->object_max_size != config->object_min_size) {
+        printf("-");
+        print_size(config->object_max_size);
+        printf(" (%s)", dists[config->object_size_dist]);
+    }
+    printf(", ");
+    if(config->object_fsync)
+        printf("fsync, ");
+    if(config->object_rename)
+        printf("rename commit, ");
+    printf("directory tree: %d:%d, objects per thread: %d, ",
+           config->dir_fanout, config->dir_depth, config->meta_files);
+}
+
+void print_status(off64_t length, workload_config_t *config) {
+    if(config->silent)
+        return;
     
+    printf("Benchmarking results for [%s]", config->device);
+    if(!uses_dir_tree(config)) {
+        printf(" (");
+        print_size(length);
+        printf(")");
+    }
+    printf("\n");
+        
+    printf("[duration: ");
+    if(config->duration_unit == dut_time) {
+        printf("%llds, ", config->duration);
+    } else if(config->duration_unit == dut_space) {
+        print_size(config->duration);
+        printf(", ");
+    } else {
+        printf("interactive, ");
+    }
+
+    if(config->offset != 0) {
+        printf("offset: ");
+        print_size(config->offset);
+        printf(", ");
+    }
+    if(config->length != config->device_length) {
+        printf("length: ");
+        print_size(config->length);
+        printf(", ");
+    }
+
+    printf("threads: %d, ", config->threads);
+
+    if(config->threads > 1) {
+        printf("fd: ");
+        if(config->local_fd)
+            printf("local, ");
+        else
+            printf("shared, ");
+    }
+    
+    if(config->io_type == iot_meta)
+        print_meta_status(config);
+    else if(config->io_type == iot_object)
+        print_object_status(config);
+    else
+        print_operation_status(config);
+
     printf("direct IO: ");
     if(config->direct_io)
         printf("on, ");
@@ -605,6 +1565,18 @@ void print_status(off64_t length, workload_config_t *config) {
         printf("native AIO, ");
     else if(config->io_type == iot_mmap)
         printf("mmap, ");
+    else if(config->io_type == iot_sendfile)
+        printf("sendfile, ");
+    else if(config->io_type == iot_splice)
+        printf("splice, ");
+    else if(config->io_type == iot_copy_range)
+        printf("copy_file_range (%s), ", config->copy_file);
+    else if(config->io_type == iot_null)
+        printf("null, ");
+    else if(config->io_type == iot_meta)
+        printf("metadata, ");
+    else if(config->io_type == iot_object)
+        printf("object, ");
     else
         check("Invalid IO type", 1);
 
@@ -612,6 +1584,40 @@ void print_status(off64_t length, workload_config_t *config) {
         printf("queue depth: %d, ", config->queue_depth);
     }
     
+    if(config->io_type == iot_mmap) {
+        printf("mmap window: ");
+        if(config->mmap_window == 0)
+            printf("full");
+        else
+            print_size(config->mmap_window);
+        printf(", populate: ");
+        if(config->mmap_populate)
+            printf("on, ");
+        else
+            printf("off, ");
+        printf("madvise: ");
+        if(config->mmap_advice == mad_normal)
+            printf("normal, ");
+        else if(config->mmap_advice == mad_random)
+            printf("random, ");
+        else if(config->mmap_advice == mad_sequential)
+            printf("sequential, ");
+        else if(config->mmap_advice == mad_willneed)
+            printf("willneed, ");
+        else if(config->mmap_advice == mad_hugepage)
+            printf("hugepage, ");
+        else
+            check("Invalid madvise mode", 1);
+        if(config->operation == op_write && !config->buffered) {
+            printf("msync: ");
+            if(config->msync_async)
+                printf("async, ");
+            else
+                printf("sync, ");
+            printf("msync batch: %d, ", config->msync_batch);
+        }
+    }
+
     if(config->io_type == iot_naio) {
         printf("eventfd: ");
         if(config->use_eventfd)
@@ -648,10 +1654,54 @@ void print_status(off64_t length, workload_config_t *config) {
     printf(", sample step: %d", config->sample_step);
     if(config->sample_step != 0)
         printf("ms");
+    else
+        printf(", latency capture: %d (%s)", config->latency_capacity,
+               config->latency_capture == lct_ring ? "ring" : "reservoir");
     
     printf(", pause interval: %ld", config->pause_interval);
     if(config->pause_interval != 0)
         printf("us");
+
+    if(config->clock_source == cls_tsc)
+        printf(", clock: tsc");
+
+    if(config->warmup != 0) {
+        printf(", warmup: ");
+        if(config->warmup_unit == dut_time)
+            printf("%llds", config->warmup);
+        else
+            print_size(config->warmup);
+    }
+    if(config->steady_state_rounds != 0)
+        printf(", steady state window: %d sample steps", config->steady_state_rounds);
+    if(config->file_set) {
+        const char *selections[] = { "uniform", "zipf", "round robin" };
+        printf(", file selection: %s", selections[config->file_select]);
+        if(config->file_select == fsl_zipf)
+            printf(" (exponent %g)", config->zipf_exponent);
+        if(config->files_per_thread)
+            printf(" per thread");
+        if(config->fd_cache != 0)
+            printf(", fd cache: %d", config->fd_cache);
+    }
+    if(config->repeat > 1)
+        printf(", repeat: %d", config->repeat);
+    if(config->phase_count != 0) {
+        printf(", phases: ");
+        for(int i = 0; i < config->phase_count; i++) {
+            phase_t *phase = &config->phases[i];
+            printf("%s%s %llds", i > 0 ? ", " : "", phase->name, phase->duration);
+            if(phase->rate == PHASE_IDLE)
+                printf(" idle");
+            else if(phase->rate != 0)
+                printf(" at %d ops/sec", phase->rate);
+        }
+    }
+    if(config->precondition_passes != -1) {
+        printf(", precondition: %d passes, then ", config->precondition_passes);
+        print_size(config->precondition_block_size);
+        printf(" random writes");
+    }
     
     printf("]\n");
 }
@@ -15,7 +15,13 @@ enum io_type_t {
     iot_stateless,
     iot_paio,
     iot_naio,
-    iot_mmap
+    iot_mmap,
+    iot_sendfile,
+    iot_splice,
+    iot_copy_range,
+    iot_null,
+    iot_meta,
+    iot_object
 };
 enum op_direction_t {
     opd_forward,
@@ -26,12 +32,68 @@ enum operation_t {
     op_write,
     op_trim
 };
+enum trim_mode_t {
+    trm_auto,
+    trm_discard,
+    trm_punch_hole,
+    trm_zero_range,
+    trm_zero_out,
+    trm_secure_discard
+};
+enum latency_capture_t {
+    lct_reservoir,
+    lct_ring
+};
 enum rnd_dist_t {
     rdt_const,
     rdt_uniform,
     rdt_normal,
     rdt_power
 };
+enum mmap_advice_t {
+    mad_normal,
+    mad_random,
+    mad_sequential,
+    mad_willneed,
+    mad_hugepage
+};
+enum output_format_t {
+    ofm_text,
+    ofm_json,
+    ofm_csv
+};
+enum clock_source_t {
+    cls_monotonic,
+    cls_tsc
+};
+enum file_select_t {
+    fsl_uniform,
+    fsl_zipf,
+    fsl_round_robin
+};
+enum meta_op_t {
+    mop_create,
+    mop_stat,
+    mop_open,
+    mop_rename,
+    mop_unlink,
+    mop_fsync_dir,
+    mop_count
+};
+// Ops run as dependent sequences of steps
+enum pattern_t {
+    pat_none,
+    pat_rmw,
+    pat_journal,
+    pat_rmw_journal
+};
+enum pattern_step_t {
+    pst_read,
+    pst_write,
+    pst_journal, // a write to the journal area
+    pst_sync,
+    pst_count
+};
 enum duration_unit_t {
     dut_time,
     dut_space,
@@ -40,6 +102,36 @@ enum duration_unit_t {
 
 // Workload config
 #define DEVICE_NAME_LENGTH 512
+#define MAX_PERCENTILE_MARKS 32
+#define CALIBRATION_MS 250
+// Steady state: the throughput of the last rounds may not vary by more
+// than 20% of their mean, nor their fitted trend by more than 10%
+#define STEADY_STATE_RANGE 0.2
+#define STEADY_STATE_SLOPE 0.1
+// Preconditioning runs on native AIO at this queue depth
+#define PRECONDITION_QUEUE_DEPTH 32
+#define PRECONDITION_FILL_BLOCK_SIZE (1024 * 1024)
+#define PRECONDITION_ROUNDS 5
+#define MAX_PHASES 32
+#define PHASE_NAME_LENGTH 32
+#define PHASE_IDLE -1
+// Directories at the bottom level of a metadata tree
+#define MAX_DIR_TREE_LEAVES 1000000
+// Every thread of an object workload holds the largest object in memory
+#define MAX_OBJECT_SIZE (256 * 1024 * 1024)
+// Spread of the normal and power object size distributions, as for
+// offsets (see --sigma)
+#define OBJECT_SIZE_SIGMA 20
+// Blocks at the end of the range journal writes go round, as big as
+// the doublewrite buffer of InnoDB with its default page size
+#define JOURNAL_BLOCKS 128
+#define MAX_PATTERN_STEPS 8
+// A stretch of the run with its own target rate
+struct phase_t {
+    char name[PHASE_NAME_LENGTH];
+    long long duration; // in seconds
+    int rate; // ops/sec for the whole workload, 0 if unlimited, PHASE_IDLE if idle
+};
 struct workload_config_t {
     int threads;
     int block_size;
@@ -48,6 +140,10 @@ struct workload_config_t {
     int stride;
     char device[DEVICE_NAME_LENGTH];
     char output_file[DEVICE_NAME_LENGTH];
+    char copy_file[DEVICE_NAME_LENGTH];
+    char trace_file[DEVICE_NAME_LENGTH];
+    char histogram_file[DEVICE_NAME_LENGTH];
+    char metrics_address[DEVICE_NAME_LENGTH];
     off64_t offset;
     off64_t length;
     off64_t device_length;
@@ -64,17 +160,78 @@ struct workload_config_t {
     rnd_dist_t dist;
     int sigma;
     int silent;    
+    output_format_t format;
     int drop_caches;
     int use_eventfd;
+    int perf;
+    int device_stats;
+    clock_source_t clock_source;
+    int calibrate;
+    long long warmup;
+    duration_unit_t warmup_unit;
+    int steady_state_rounds;
+    int precondition_passes; // -1 if not preconditioning
+    int precondition_block_size;
+    long long precondition_time;
+    char precondition_state[DEVICE_NAME_LENGTH];
+    // Sequential writes stop at the end of the range instead of growing
+    // the file (set for preconditioning passes)
+    int fill;
+    int file_set; // DEVICE is a directory, a glob or a file list
+    file_select_t file_select;
+    double zipf_exponent;
+    int files_per_thread;
+    int fd_cache; // open files per thread, 0 to keep every file open
+    // Metadata workloads, on a tree of directories under DEVICE
+    int meta_weights[mop_count]; // relative share of every op
+    int dir_fanout;
+    int dir_depth;
+    int meta_files; // files every thread creates before the run
+    // Object workloads, whole files of the tree read or written per op
+    int object_min_size;
+    int object_max_size;
+    rnd_dist_t object_size_dist;
+    int object_fsync;
+    int object_rename; // write a temporary file and rename it over the object
+    pattern_t pattern;
+    off64_t journal_offset; // start of the journal area, past the range
+    int repeat;
+    char baseline_file[DEVICE_NAME_LENGTH];
+    phase_t phases[MAX_PHASES];
+    int phase_count; // zero for a single unthrottled run
+    off64_t mmap_window;
+    int mmap_populate;
+    mmap_advice_t mmap_advice;
+    int msync_async;
+    int msync_batch;
+    trim_mode_t trim_mode;
+    off64_t trim_batch;
     int sample_step;
+    double percentile_marks[MAX_PERCENTILE_MARKS]; // fractions, sorted
+    int percentile_mark_count; // zero for the default marks
+    int latency_capacity;
+    latency_capture_t latency_capture;
     long pause_interval; // in microseconds bool enable_latency_tracing;    
 };
 
 // Operations
 void check(const char *str, int error);
 void usage(const char *name);
+void init_workload_config(workload_config_t *config);
 void parse_options(int argc, char *argv[], workload_config_t *config);
 void print_status(off64_t length, workload_config_t *config);
+// Index of the phase running this many seconds into the measured run
+int phase_at(workload_config_t *config, double secs);
+// Whether the workload runs on a tree of files it creates under DEVICE
+int uses_dir_tree(workload_config_t *config);
+// Option values as accepted on the command line
+const char* io_type_name(io_type_t io_type);
+const char* operation_name(operation_t operation);
+const char* meta_op_name(meta_op_t op);
+const char* pattern_name(pattern_t pattern);
+const char* pattern_step_name(pattern_step_t step);
+// Fills steps with the steps of an op of the pattern and returns their number
+int get_pattern_steps(pattern_t pattern, pattern_step_t *steps);
 
 #endif // __OPTS_HPP__
 
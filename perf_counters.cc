@@ -0,0 +1,95 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perf_counters.hpp"
+
+static int open_counter(__u32 type, __u64 config, int exclude_kernel) {
+    perf_event_attr attr;
+    bzero(&attr, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // This thread only, on whichever CPU it runs
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long syscall_tracepoint_id() {
+    const char *paths[] = { "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+                            "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id" };
+    for(int i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        FILE *file = fopen(paths[i], "r");
+        if(file == NULL)
+            continue;
+        long long id = -1;
+        if(fscanf(file, "%lld", &id) != 1)
+            id = -1;
+        fclose(file);
+        if(id != -1)
+            return id;
+    }
+    return -1;
+}
+
+perf_counters_t::perf_counters_t()
+    : user_only(0)
+{
+    fds[pfc_cycles] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 0);
+    fds[pfc_instructions] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 0);
+    if(fds[pfc_cycles] == -1 && fds[pfc_instructions] == -1) {
+        fds[pfc_cycles] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 1);
+        fds[pfc_instructions] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 1);
+        user_only = fds[pfc_cycles] != -1 || fds[pfc_instructions] != -1;
+    }
+    fds[pfc_context_switches] = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, 0);
+    fds[pfc_page_faults] = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, 0);
+
+    long long id = syscall_tracepoint_id();
+    fds[pfc_syscalls] = id == -1 ? -1 : open_counter(PERF_TYPE_TRACEPOINT, id, 0);
+}
+
+perf_counters_t::~perf_counters_t() {
+    for(int i = 0; i < pfc_count; i++) {
+        if(fds[i] != -1)
+            close(fds[i]);
+    }
+}
+
+void perf_counters_t::start() {
+    for(int i = 0; i < pfc_count; i++) {
+        if(fds[i] != -1) {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void perf_counters_t::stop(long long *values) {
+    for(int i = 0; i < pfc_count; i++) {
+        values[i] = -1;
+        if(fds[i] == -1)
+            continue;
+        ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        // value, time enabled, time running
+        unsigned long long data[3];
+        if(read(fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0)
+            continue;
+        // Scale up if the counter had to share the PMU with others
+        values[i] = (long long)((double)data[0] * data[1] / data[2]);
+    }
+}
+
+const char* perf_counter_name(perf_counter_t counter) {
+    const char *names[] = { "cycles", "instructions", "context_switches", "page_faults", "syscalls" };
+    return names[counter];
+}
@@ -0,0 +1,34 @@
+#ifndef __PERF_COUNTERS_HPP__
+#define __PERF_COUNTERS_HPP__
+
+enum perf_counter_t {
+    pfc_cycles,
+    pfc_instructions,
+    pfc_context_switches,
+    pfc_page_faults,
+    pfc_syscalls,
+    pfc_count
+};
+
+// perf_event_open counters for the calling thread. Counters the kernel
+// or the permissions don't allow stay unavailable (-1) instead of
+// failing the run. Cycles and instructions fall back to user space only
+// counting when kernel profiling isn't permitted.
+class perf_counters_t {
+public:
+    perf_counters_t();
+    ~perf_counters_t();
+
+    void start();
+    // Stops counting and stores the (multiplexing scaled) counts in values
+    void stop(long long *values);
+
+    int user_only;
+
+private:
+    int fds[pfc_count];
+};
+
+const char* perf_counter_name(perf_counter_t counter);
+
+#endif // __PERF_COUNTERS_HPP__
@@ -0,0 +1,243 @@
+
+#include <aio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <vector>
+#include "opts.hpp"
+#include "utils.hpp"
+#include "stream_stat.hpp"
+#include "workload.hpp"
+#include "io_engine.hpp"
+#include "io_engines.hpp"
+
+#define BENCH_MS 200
+#define MAX_THREADS 64
+#define LATENCY_VALUES 4096
+
+// Latencies from 100ns to ~100ms, spread over the histogram buckets
+ticks_t latency_values[LATENCY_VALUES];
+
+void init_latency_values() {
+    unsigned long long state = 88172645463325252ULL;
+    for(int i = 0; i < LATENCY_VALUES; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        ticks_t value = 100;
+        for(int digits = state % 7; digits > 0; digits--)
+            value *= 10;
+        latency_values[i] = value + (state >> 32) % value;
+    }
+}
+
+// Runs a benchmark in batches of doubling size until a batch takes at
+// least BENCH_MS, returns the time per call of that batch in nanoseconds
+typedef void (*bench_fn_t)(void *arg, long iterations);
+
+double time_bench(bench_fn_t fn, void *arg) {
+    for(long iterations = 1000; ; iterations *= 2) {
+        ticks_t start = get_monotonic_ticks();
+        fn(arg, iterations);
+        ticks_t elapsed = get_monotonic_ticks() - start;
+        if(ticks_to_ms(elapsed) >= BENCH_MS)
+            return (double)elapsed / iterations;
+    }
+}
+
+void report(const char *name, double ns_per_op) {
+    printf("%-32s %10.1f ns/op\n", name, ns_per_op);
+}
+
+/**
+ * Stats
+ **/
+void bench_stat_add(void *arg, long iterations) {
+    stream_stat_t *stat = (stream_stat_t*)arg;
+    for(long i = 0; i < iterations; i++)
+        stat->add(latency_values[i & (LATENCY_VALUES - 1)]);
+}
+
+void bench_stat_get(void *arg, long iterations) {
+    stream_stat_t *stat = (stream_stat_t*)arg;
+    long count = 0;
+    for(long i = 0; i < iterations; i++)
+        count += stat->get_global_stat().count;
+    if(count == 0)
+        printf("\n"); // keep the calls from being optimized out
+}
+
+void bench_stat_snapshot(void *arg, long iterations) {
+    stream_stat_t *stat = (stream_stat_t*)arg;
+    for(long i = 0; i < iterations; i++)
+        stat->snapshot_and_reset();
+}
+
+/**
+ * Offsets
+ **/
+struct offset_bench_t {
+    rnd_gen_t rnd_gen;
+    workload_config_t config;
+};
+
+void bench_get_random(void *arg, long iterations) {
+    offset_bench_t *bench = (offset_bench_t*)arg;
+    off64_t sum = 0;
+    for(long i = 0; i < iterations; i++)
+        sum += get_random(bench->rnd_gen, bench->config.dist, bench->config.length, bench->config.sigma);
+    if(sum == -1)
+        printf("\n");
+}
+
+void bench_prepare_offset(void *arg, long iterations) {
+    offset_bench_t *bench = (offset_bench_t*)arg;
+    off64_t sum = 0;
+    for(long i = 0; i < iterations; i++)
+        sum += prepare_offset(i, bench->rnd_gen, &bench->config);
+    if(sum == -1)
+        printf("\n");
+}
+
+/**
+ * Clock
+ **/
+void bench_get_ticks(void *arg, long iterations) {
+    ticks_t sum = 0;
+    for(long i = 0; i < iterations; i++)
+        sum += get_ticks();
+    if(sum == 0)
+        printf("\n");
+}
+
+/**
+ * push_latency scaling
+ **/
+class bench_engine_t : public io_engine_null_t {
+public:
+    bench_engine_t(stream_stat_t *_stream_stat, pthread_mutex_t *_latency_mutex)
+        : io_engine_null_t(NULL, _stream_stat, _latency_mutex)
+        {}
+
+    void push(ticks_t latency) {
+        push_latency(latency);
+    }
+};
+
+struct push_thread_t {
+    bench_engine_t *engine;
+    pthread_barrier_t *barrier;
+    volatile int *is_done;
+    long ops;
+};
+
+void* push_worker(void *arg) {
+    push_thread_t *thread = (push_thread_t*)arg;
+    pthread_barrier_wait(thread->barrier);
+    long ops = 0;
+    while(!*thread->is_done) {
+        thread->engine->push(latency_values[ops & (LATENCY_VALUES - 1)]);
+        ops++;
+    }
+    thread->ops = ops;
+    return NULL;
+}
+
+// Returns the total push_latency calls per second of all threads
+double bench_push_latency(workload_config_t *config, int threads) {
+    stream_stat_t stat(LATENCY_BUCKETS, LATENCY_BUCKET_SIZE_EXP);
+    pthread_mutex_t latency_mutex;
+    pthread_mutex_init(&latency_mutex, NULL);
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, threads + 1);
+    volatile int is_done = 0;
+
+    std::vector<push_thread_t> states(threads);
+    std::vector<pthread_t> ids(threads);
+    for(int i = 0; i < threads; i++) {
+        states[i].engine = new bench_engine_t(&stat, &latency_mutex);
+        states[i].engine->config = config;
+        states[i].barrier = &barrier;
+        states[i].is_done = &is_done;
+        states[i].ops = 0;
+        check("Error creating thread",
+              pthread_create(&ids[i], NULL, &push_worker, &states[i]) != 0);
+    }
+
+    pthread_barrier_wait(&barrier);
+    ticks_t start = get_monotonic_ticks();
+    usleep(BENCH_MS * 1000);
+    is_done = 1;
+    long ops = 0;
+    for(int i = 0; i < threads; i++) {
+        check("Error joining thread", pthread_join(ids[i], NULL) != 0);
+        ops += states[i].ops;
+        delete states[i].engine;
+    }
+    ticks_t elapsed = get_monotonic_ticks() - start;
+
+    pthread_barrier_destroy(&barrier);
+    pthread_mutex_destroy(&latency_mutex);
+    return ops / ticks_to_secs(elapsed);
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc != 1) {
+        printf("Usage:\n");
+        printf("\t%s\n", argv[0]);
+        printf("\nTimes rebench's own hot paths (stats, offsets, clock and the shared\n");
+        printf("latency path under 1 to %d threads) and reports ns/op and scaling.\n", MAX_THREADS);
+        exit(0);
+    }
+
+    init_clock(cls_monotonic);
+    init_latency_values();
+
+    stream_stat_t stat(LATENCY_BUCKETS, LATENCY_BUCKET_SIZE_EXP);
+    report("stream_stat add", time_bench(bench_stat_add, &stat));
+    report("stream_stat get_global_stat", time_bench(bench_stat_get, &stat));
+    report("stream_stat snapshot_and_reset", time_bench(bench_stat_snapshot, &stat));
+
+    offset_bench_t offsets;
+    offsets.rnd_gen = init_rnd_gen();
+    check("Error initializing random numbers", offsets.rnd_gen == NULL);
+    init_workload_config(&offsets.config);
+    offsets.config.device_length = 1024LL * 1024 * 1024 * 1024;
+    offsets.config.length = offsets.config.device_length;
+    offsets.config.sigma = 5;
+    const char *dists[] = { "const", "uniform", "normal", "power" };
+    rnd_dist_t dist_types[] = { rdt_const, rdt_uniform, rdt_normal, rdt_power };
+    for(int i = 0; i < sizeof(dist_types) / sizeof(dist_types[0]); i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "get_random %s", dists[i]);
+        offsets.config.dist = dist_types[i];
+        report(name, time_bench(bench_get_random, &offsets));
+    }
+    offsets.config.dist = rdt_uniform;
+    offsets.config.workload = wl_rnd;
+    report("prepare_offset rnd", time_bench(bench_prepare_offset, &offsets));
+    offsets.config.workload = wl_seq;
+    report("prepare_offset seq", time_bench(bench_prepare_offset, &offsets));
+    free_rnd_gen(offsets.rnd_gen);
+
+    report("get_ticks monotonic", time_bench(bench_get_ticks, NULL));
+    if(init_clock(cls_tsc) == cls_tsc)
+        report("get_ticks tsc", time_bench(bench_get_ticks, NULL));
+    init_clock(cls_monotonic);
+
+    // The latency path takes the shared mutex, so it doesn't scale with
+    // threads; track how much worse it gets
+    workload_config_t config;
+    init_workload_config(&config);
+    double base = 0;
+    printf("\npush_latency:\n");
+    for(int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        double ops_per_sec = bench_push_latency(&config, threads);
+        if(threads == 1)
+            base = ops_per_sec;
+        printf("  threads: %2d - %10.1f ns/op per thread, %8.2f Mops/sec total, scaling - %.2f\n",
+               threads, threads * 1000000000.0 / ops_per_sec, ops_per_sec / 1000000.0, ops_per_sec / base);
+    }
+}
@@ -0,0 +1,68 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "utils.hpp"
+
+#define OVERHEAD_CALLS 10000000
+#define RESOLUTION_CALLS 1000000
+
+void test_clock(const char *name) {
+    // Cost of a call, timed with the monotonic clock either way
+    ticks_t sum = 0;
+    ticks_t start = get_monotonic_ticks();
+    for(int i = 0; i < OVERHEAD_CALLS; i++)
+        sum += get_ticks();
+    ticks_t end = get_monotonic_ticks();
+    double overhead = (double)(end - start) / OVERHEAD_CALLS;
+
+    // Smallest step between two consecutive reads
+    ticks_t resolution = 0;
+    long repeats = 0;
+    ticks_t last = get_ticks();
+    for(int i = 0; i < RESOLUTION_CALLS; i++) {
+        ticks_t now = get_ticks();
+        if(now == last)
+            repeats++;
+        else if(resolution == 0 || now - last < resolution)
+            resolution = now - last;
+        last = now;
+    }
+
+    printf("%s: overhead - %.1f ns/call, resolution - %llu ns, %.1f%% of consecutive reads equal\n",
+           name, overhead, resolution, repeats * 100.0 / RESOLUTION_CALLS);
+    if(sum == 0)
+        printf("\n"); // keep the calls from being optimized out
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc != 1) {
+        printf("Usage:\n");
+        printf("\t%s\n", argv[0]);
+        printf("\nReports the overhead and resolution of the clock sources 'rebench --clock'\n");
+        printf("can use on this machine.\n");
+        exit(0);
+    }
+
+    init_clock(cls_monotonic);
+    test_clock("monotonic");
+
+    if(!tsc_available()) {
+        printf("tsc: not available (no invariant TSC)\n");
+        return 0;
+    }
+    if(init_clock(cls_tsc) != cls_tsc) {
+        printf("tsc: not usable (calibrations against the monotonic clock disagree)\n");
+        return 0;
+    }
+    test_clock("tsc");
+
+    // How far the calibrated TSC drifts from the monotonic clock
+    ticks_t tsc_start = get_ticks(), monotonic_start = get_monotonic_ticks();
+    sleep(1);
+    ticks_t tsc_end = get_ticks(), monotonic_end = get_monotonic_ticks();
+    double drift = ((double)(tsc_end - tsc_start) - (double)(monotonic_end - monotonic_start))
+        / (monotonic_end - monotonic_start) * 1000000.0;
+    printf("tsc: %.3f GHz, drift against the monotonic clock - %.1f ppm\n", get_tsc_ghz(), drift);
+}
@@ -0,0 +1,61 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "histogram_file.hpp"
+#include "stream_stat.hpp"
+
+int main(int argc, char *argv[])
+{
+    histogram_record_t type = hrt_total;
+    double marks[MAX_PERCENTILE_MARKS];
+    int mark_count = 0;
+    int first = 1;
+    while(first < argc) {
+        if(strcmp(argv[first], "--intervals") == 0) {
+            type = hrt_interval;
+            first++;
+        } else if(strcmp(argv[first], "--percentiles") == 0 && first + 1 < argc) {
+            mark_count = parse_percentile_marks(argv[first + 1], marks, MAX_PERCENTILE_MARKS);
+            check("Invalid percentiles (use a comma separated list of values in (0, 100] or 'max')",
+                  mark_count == -1);
+            first += 2;
+        } else {
+            break;
+        }
+    }
+
+    if(first >= argc) {
+        printf("Usage:\n");
+        printf("\t%s [--intervals] [--percentiles LIST] HISTOGRAM_FILE...\n", argv[0]);
+        printf("\nMerges histograms written with 'rebench --histogram' and reports the combined\n");
+        printf("latency statistics. By default the whole-run histogram of every file is merged,\n");
+        printf("--intervals merges the per sample step histograms instead. --percentiles takes\n");
+        printf("the same comma separated list as rebench.\n");
+        exit(0);
+    }
+
+    stream_stat_t stream_stat(LATENCY_BUCKETS, LATENCY_BUCKET_SIZE_EXP);
+    if(mark_count > 0)
+        stream_stat.set_percentile_marks(std::vector<double>(marks, marks + mark_count));
+    int files = 0, records = 0;
+    for(int i = first; i < argc; i++) {
+        int merged = merge_histogram_file(argv[i], type, &stream_stat);
+        if(merged == 0)
+            fprintf(stderr, "Warning: no %s histograms in %s\n",
+                    type == hrt_total ? "whole-run" : "interval", argv[i]);
+        records += merged;
+        files++;
+    }
+
+    stat_data_t stat_data = stream_stat.get_global_stat();
+    printf("Merged %d histograms from %d files: %ld ops\n", records, files, stat_data.count);
+    if(stat_data.count == 0)
+        return 0;
+    printf("Latency statistics: mean - %.3f us, min - %.3f us, max - %.3f us | percentiles: ",
+           stat_data.mean / 1000.0, ticks_to_us(stat_data.min_value), ticks_to_us(stat_data.max_value));
+    for(std::map<double, ticks_t>::iterator it = stat_data.percentiles.begin(); it != stat_data.percentiles.end(); ++it) {
+        printf("%gth - %.3f us; ", it->first*100, ticks_to_us(it->second));
+    }
+    printf("\n");
+}
@@ -0,0 +1,16 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "trace.hpp"
+
+int main(int argc, char *argv[])
+{
+    if(argc != 2) {
+        printf("Usage:\n");
+        printf("\t%s TRACE_FILE\n", argv[0]);
+        printf("\nConverts a binary trace recorded with 'rebench --trace' to tab separated text.\n");
+        exit(0);
+    }
+
+    print_trace(argv[1]);
+}
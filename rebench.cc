@@ -9,11 +9,18 @@
 #include <algorithm>
 #include <sys/mman.h>
 #include <vector>
+#include <string>
 #include <math.h>
+#include <errno.h>
+#include <libaio.h>
 #include "opts.hpp"
 #include "utils.hpp"
 #include "io_engine.hpp"
 #include "simulation.hpp"
+#include "histogram_file.hpp"
+#include "report.hpp"
+#include "metrics.hpp"
+#include "repeat.hpp"
 
 void parse_workloads(int argc, char *argv[], wsp_vector *workloads) {
     // Parse the workloads
@@ -34,6 +41,7 @@ void parse_workloads(int argc, char *argv[], wsp_vector *workloads) {
                 if(ws->config.duration_unit == dut_interactive) {
                     check("Cannot run in interactive mode with stdin workloads", 1);
                 }
+                ws->metrics_slot = workloads->size();
                 workloads->push_back(ws);
             }
         }
@@ -52,19 +60,97 @@ void drop_workload_caches(wsp_vector *workloads) {
     for(wsp_vector::iterator it = workloads->begin(); it != workloads->end(); ++it) {
         workload_simulation_t *ws = *it;
         if(ws->config.drop_caches) {
-            drop_caches(ws->config.device);
+            if(ws->config.file_set)
+                drop_file_set_caches(ws->config.device);
+            else
+                drop_caches(ws->config.device);
         }
     }
 }
 
-void start_simulations(wsp_vector *workloads) {
+void init_clock_source(wsp_vector *workloads) {
+    // Ticks have to be comparable across workloads, so there is one clock
+    clock_source_t source = cls_monotonic;
+    for(wsp_vector::iterator it = workloads->begin(); it != workloads->end(); ++it) {
+        if((*it)->config.clock_source == cls_tsc)
+            source = cls_tsc;
+    }
+    clock_source_t actual = init_clock(source);
+    if(actual != source)
+        fprintf(stderr, "Warning: the TSC isn't usable as a clock here, using CLOCK_MONOTONIC\n");
+    for(wsp_vector::iterator it = workloads->begin(); it != workloads->end(); ++it)
+        (*it)->config.clock_source = actual;
+}
+
+void calibrate_workloads(wsp_vector *workloads) {
+    // Measure the ceiling before any IO so the runs don't disturb each other
+    for(wsp_vector::iterator it = workloads->begin(); it != workloads->end(); ++it) {
+        workload_simulation_t *ws = *it;
+        if(!ws->config.calibrate || ws->config.io_type == iot_null ||
+           ws->config.duration_unit == dut_interactive)
+            continue;
+        ws->harness_ops_per_sec = calibrate_harness(&ws->config);
+    }
+}
+
+metrics_server_t* start_metrics_server(wsp_vector *workloads) {
+    // A single endpoint serves every workload
+    const char *address = NULL;
+    for(wsp_vector::iterator it = workloads->begin(); it != workloads->end(); ++it) {
+        workload_simulation_t *ws = *it;
+        if(ws->config.metrics_address[0] == 0)
+            continue;
+        if(address == NULL)
+            address = ws->config.metrics_address;
+        else
+            check("Only one metrics endpoint can be served per run",
+                  strcmp(address, ws->config.metrics_address) != 0);
+    }
+    if(address == NULL)
+        return NULL;
+
+    metrics_server_t *metrics = new metrics_server_t(address, workloads->size());
+    metrics->start();
+    return metrics;
+}
+
+void publish_metrics(metrics_server_t *metrics, int workload, workload_simulation_t *ws,
+                     long long ops_so_far, int ops_per_sec) {
+    metrics_sample_t sample;
+    sample.device = ws->config.device;
+    sample.operation = operation_name(ws->config.operation);
+    sample.type = io_type_name(ws->config.io_type);
+    sample.ops = ops_so_far;
+    sample.bytes = ops_so_far * ws->config.block_size;
+    sample.ops_per_sec = ops_per_sec;
+    sample.bytes_per_sec = (double)ops_per_sec * ws->config.block_size;
+    stat_data_t stat_data = ws->stream_stat->get_snapshot_stat();
+    if(stat_data.count > 0) {
+        sample.mean_latency = stat_data.mean;
+        sample.max_latency = stat_data.max_value;
+        sample.percentiles = stat_data.percentiles;
+    }
+    for(int i = 0; i < ws->engines.size(); i++)
+        sample.in_flight += __atomic_load_n(&ws->engines[i]->in_flight, __ATOMIC_RELAXED);
+    sample.done = ws->is_done;
+    if(ws->config.phase_count != 0)
+        sample.phase = ws->phase;
+    metrics->update(workload, sample);
+}
+
+void start_simulations(wsp_vector *workloads, pthread_barrier_t *start_barrier) {
     // Start the simulations
     int workload = 1;
+    int total_threads = 0;
+    for(wsp_vector::iterator it = workloads->begin(); it != workloads->end(); ++it)
+        total_threads += (*it)->config.threads;
+    check("Could not create the start barrier",
+          pthread_barrier_init(start_barrier, NULL, total_threads + 1) != 0);
     
     for(wsp_vector::iterator it = workloads->begin(); it != workloads->end(); ++it) {
         workload_simulation_t *ws = *it;
 
-        if(!ws->config.silent) {
+        if(!ws->config.silent && ws->config.format == ofm_text) {
             if(workloads->size() > 1) {
                 printf("Starting workload %d...\n", workload);
                 if(workload == workloads->size())
@@ -77,17 +163,79 @@ void start_simulations(wsp_vector *workloads) {
         workload++;
 
         ws->is_done = 0;
+        ws->is_joined = 0;
         ws->ops = 0;
+        ws->phase = 0;
         ws->mmap = NULL;
-        ws->start_time = get_ticks();	
-	ws->stream_stat = new stream_stat_t(12, 3); // trace latencies up to 10^12 nanoseconds, estimation error 0.1% (10^-3)
+	ws->stream_stat = new stream_stat_t(LATENCY_BUCKETS, LATENCY_BUCKET_SIZE_EXP);
+	ws->flush_stat = new stream_stat_t(LATENCY_BUCKETS, LATENCY_BUCKET_SIZE_EXP);
+        for(int i = 0; i < mop_count; i++) {
+            ws->meta_stats[i] = NULL;
+            if(ws->config.io_type == iot_meta)
+                ws->meta_stats[i] = new stream_stat_t(LATENCY_BUCKETS, LATENCY_BUCKET_SIZE_EXP);
+        }
+        for(int i = 0; i < pst_count; i++) {
+            ws->step_stats[i] = NULL;
+            if(ws->config.pattern != pat_none)
+                ws->step_stats[i] = new stream_stat_t(LATENCY_BUCKETS, LATENCY_BUCKET_SIZE_EXP);
+        }
+        if(ws->config.percentile_mark_count > 0) {
+            std::vector<double> marks(ws->config.percentile_marks,
+                                      ws->config.percentile_marks + ws->config.percentile_mark_count);
+            ws->stream_stat->set_percentile_marks(marks);
+            ws->flush_stat->set_percentile_marks(marks);
+            for(int i = 0; i < mop_count; i++) {
+                if(ws->meta_stats[i])
+                    ws->meta_stats[i]->set_percentile_marks(marks);
+            }
+            for(int i = 0; i < pst_count; i++) {
+                if(ws->step_stats[i])
+                    ws->step_stats[i]->set_percentile_marks(marks);
+            }
+        }
+        ws->latencies = NULL;
+        // Every thread of the workload writes its samples to the same file
+        ws->output_fd = -1;
+        if(ws->config.output_file[0] != 0) {
+            ws->output_fd = open(ws->config.output_file,
+                                 O_CREAT | (ws->output_append ? 0 : O_TRUNC) | O_APPEND | O_WRONLY,
+                                 S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+            check("Error opening the data file", ws->output_fd == -1);
+        }
+        ws->histogram_fd = -1;
+        if(ws->config.histogram_file[0] != 0)
+            ws->histogram_fd = open_histogram_file(ws->config.histogram_file);
+        if(ws->config.sample_step == 0)
+            ws->latencies = new latency_buffer_t(ws->config.latency_capacity, ws->config.latency_capture);
+        ws->trace_writer = NULL;
+        if(ws->config.trace_file[0] != 0) {
+            ws->trace_writer = new trace_writer_t(ws->config.trace_file, ws->config.threads);
+            ws->trace_writer->start();
+        }
+        ws->file_set = NULL;
+        if(ws->config.file_set)
+            ws->file_set = new file_set_t(&ws->config);
+        ws->device_stats = NULL;
+        if(ws->config.device_stats)
+            ws->device_stats = new device_stats_t(ws->file_set ? ws->file_set->get(0)->path.c_str() : ws->config.device);
         init_std_dev(&(ws->std_dev));
         io_engine_t *first_engine = NULL;
         pthread_mutex_init(&ws->latency_mutex, NULL);
         for(int i = 0; i < ws->config.threads; i++) {
-            io_engine_t *io_engine = make_engine(ws->config.io_type, &ws->latencies, ws->stream_stat, &ws->latency_mutex);
+            io_engine_t *io_engine = make_engine(ws->config.io_type, ws->latencies, ws->stream_stat, &ws->latency_mutex);
             io_engine->config = &ws->config;
             io_engine->is_done = &ws->is_done;
+            io_engine->flush_stat = ws->flush_stat;
+            if(ws->config.io_type == iot_meta)
+                io_engine->meta_stats = ws->meta_stats;
+            if(ws->config.pattern != pat_none)
+                io_engine->step_stats = ws->step_stats;
+            io_engine->thread_id = i;
+            io_engine->start_barrier = start_barrier;
+            if(ws->config.phase_count != 0)
+                io_engine->phase = &ws->phase;
+            if(ws->trace_writer)
+                io_engine->trace_ring = ws->trace_writer->get_ring(i);
             if(!ws->config.local_fd) {
                 if(first_engine == NULL) {
                     setup_io(&ws->config, ws, io_engine);
@@ -106,12 +254,170 @@ void start_simulations(wsp_vector *workloads) {
                 first_engine = io_engine;
         }
     }
+
+    // Every thread is set up, release them all at once
+    int res = pthread_barrier_wait(start_barrier);
+    check("Could not wait for the benchmark threads", res != 0 && res != PTHREAD_BARRIER_SERIAL_THREAD);
+    ticks_t start_time = get_ticks();
+    for(wsp_vector::iterator it = workloads->begin(); it != workloads->end(); ++it) {
+        workload_simulation_t *ws = *it;
+        ws->start_time = start_time;
+        ws->run_start_time = start_time;
+        ws->is_warm = ws->config.warmup == 0;
+        if(ws->device_stats) {
+            ws->device_stats->sample(&ws->device_start);
+            ws->device_last = ws->device_start;
+        }
+    }
 }
 
-void stop_simulations(wsp_vector *workloads) {
+void set_timing_window(workload_simulation_t *ws) {
+    // Measure from the first op started to the last op completed, so
+    // thread startup and teardown stay out of the window
+    ticks_t first_op_start = 0, last_op_end = 0;
+    for(int i = 0; i < ws->engines.size(); i++) {
+        io_engine_t *engine = ws->engines[i];
+        if(engine->first_op_start == 0)
+            continue;
+        if(first_op_start == 0 || engine->first_op_start < first_op_start)
+            first_op_start = engine->first_op_start;
+        if(engine->last_op_end > last_op_end)
+            last_op_end = engine->last_op_end;
+    }
+    if(first_op_start != 0 && last_op_end > first_op_start) {
+        // After a warmup the window starts when it ended
+        ws->start_time = std::max(ws->start_time, first_op_start);
+        ws->run_start_time = first_op_start;
+        // A phased run is measured over its whole schedule, an idle or
+        // throttled trailing phase included
+        if(ws->config.phase_count == 0) {
+            ws->end_time = last_op_end;
+            ws->run_end_time = last_op_end;
+        }
+    }
+
+    if(ws->steady_state) {
+        ws->start_time = ws->steady_start_time;
+        ws->end_time = ws->steady_end_time;
+        // Only keep the latencies of the steady state window
+        ws->stream_stat->reset_global();
+        for(int i = 0; i < ws->round_histograms.size(); i++) {
+            std::vector<unsigned char> &histogram = ws->round_histograms[i];
+            check("Could not merge the steady state histograms",
+                  ws->stream_stat->merge_into_global(&histogram[0], histogram.size()) == -1);
+        }
+    }
+}
+
+void end_warmup(workload_simulation_t *ws, long long ops_so_far, ticks_t ticks_now) {
+    // Everything recorded so far was warmup, start measuring from here
+    check("Could not lock latency mutex", pthread_mutex_lock(&ws->latency_mutex) != 0);
+    ws->stream_stat->snapshot_and_reset();
+    ws->stream_stat->reset_global();
+    ws->flush_stat->snapshot_and_reset();
+    ws->flush_stat->reset_global();
+    for(int i = 0; i < mop_count; i++) {
+        if(ws->meta_stats[i]) {
+            ws->meta_stats[i]->snapshot_and_reset();
+            ws->meta_stats[i]->reset_global();
+        }
+    }
+    for(int i = 0; i < pst_count; i++) {
+        if(ws->step_stats[i]) {
+            ws->step_stats[i]->snapshot_and_reset();
+            ws->step_stats[i]->reset_global();
+        }
+    }
+    if(ws->latencies)
+        ws->latencies->reset_stats();
+    check("Could not unlock latency mutex", pthread_mutex_unlock(&ws->latency_mutex) != 0);
+
+    ws->warmup_ops = ops_so_far;
+    ws->last_ops_so_far = ops_so_far;
+    ws->warmup_ticks = ticks_now - ws->start_time;
+    ws->start_time = ticks_now;
+    ws->min_ops_per_sec = 1000000;
+    ws->max_ops_per_sec = 0;
+    init_std_dev(&ws->std_dev);
+    ws->intervals.clear();
+    if(ws->device_stats)
+        ws->device_stats->sample(&ws->device_start);
+    ws->is_warm = 1;
+}
+
+int check_steady_state(workload_simulation_t *ws) {
+    // Fit a line to the ops/sec of the last rounds
+    int rounds = ws->config.steady_state_rounds;
+    int n = ws->intervals.size();
+    if(n < rounds)
+        return 0;
+    double sum_x = 0, sum_y = 0, sum_xy = 0, sum_xx = 0;
+    double min_y = ws->intervals[n - rounds].ops_per_sec, max_y = min_y;
+    for(int i = 0; i < rounds; i++) {
+        double y = ws->intervals[n - rounds + i].ops_per_sec;
+        sum_x += i;
+        sum_y += y;
+        sum_xy += i * y;
+        sum_xx += i * i;
+        min_y = std::min(min_y, y);
+        max_y = std::max(max_y, y);
+    }
+    double mean = sum_y / rounds;
+    double slope = (rounds * sum_xy - sum_x * sum_y) / (rounds * sum_xx - sum_x * sum_x);
+    if(mean <= 0 || max_y - min_y > STEADY_STATE_RANGE * mean ||
+       fabs(slope) * (rounds - 1) > STEADY_STATE_SLOPE * mean)
+        return 0;
+
+    // The window starts where the interval before it ended
+    interval_stat_t *last = &ws->intervals[n - 1];
+    interval_stat_t *before = n > rounds ? &ws->intervals[n - rounds - 1] : NULL;
+    ws->steady_start_time = ws->start_time + (before ? before->time : 0);
+    ws->steady_end_time = ws->start_time + last->time;
+    ws->steady_ops = last->ops - (before ? before->ops : 0);
+    ws->min_ops_per_sec = (long long)min_y;
+    ws->max_ops_per_sec = (long long)max_y;
+    init_std_dev(&ws->std_dev);
+    for(int i = n - rounds; i < n; i++)
+        add_to_std_dev(&ws->std_dev, ws->intervals[i].ops_per_sec);
+    ws->steady_state = 1;
+    return 1;
+}
+
+void drain_latencies(workload_simulation_t *ws) {
+    // Grab the captured latencies under the lock, format them outside of it
+    int count = 0, first = 0;
+    check("Could not lock latency mutex", pthread_mutex_lock(&ws->latency_mutex) != 0);
+    ticks_t *latencies = ws->latencies->take(&count, &first);
+    check("Could not unlock latency mutex", pthread_mutex_unlock(&ws->latency_mutex) != 0);
+
+    if(ws->output_fd == -1)
+        return;
+
+    char buf[65536];
+    int buf_offset = 0;
+    for(int i = 0; i < count; i++) {
+        ticks_t latency = latencies[(first + i) % count];
+        int _off = snprintf(buf + buf_offset, sizeof(buf) - buf_offset,
+                            "%.2f\n", ticks_to_us(latency));
+        if(_off >= sizeof(buf) - buf_offset) {
+            // Couldn't write everything, flush and write
+            // again.
+            int res = write(ws->output_fd, buf, buf_offset);
+            check("Could not record output data", res != buf_offset);
+            buf_offset = 0;
+            _off = snprintf(buf + buf_offset, sizeof(buf) - buf_offset,
+                            "%.2f\n", ticks_to_us(latency));
+        }
+        buf_offset += _off;
+    }
+    // Write whatever we missed
+    int res = write(ws->output_fd, buf, buf_offset);
+    check("Could not record output data", res != buf_offset);
+}
+
+void stop_simulations(wsp_vector *workloads, metrics_server_t *metrics) {
     // Stop the simulations
     bool all_done = false;
-    int total_slept = 0;
     ticks_t last_ticks_now = get_ticks(), ticks_now = 0;
     workload_config_t *config = &((*(workloads->begin()))->config);       
 
@@ -123,18 +429,34 @@ void stop_simulations(wsp_vector *workloads) {
             // Compute ops so far
             long long ops_so_far = -1;
             
+            // See if the warmup is over
+            if(!ws->is_warm && !ws->is_done) {
+                ops_so_far = compute_total_ops(ws);
+                ticks_t ticks_warm = get_ticks();
+                if(ws->config.warmup_unit == dut_time ?
+                   ticks_to_secs(ticks_warm - ws->start_time) >= ws->config.warmup :
+                   ops_so_far * ws->config.block_size >= ws->config.warmup)
+                    end_warmup(ws, ops_so_far, ticks_warm);
+            }
+
+            // Move on to the next phase, the warmup runs in the first one
+            if(ws->config.phase_count != 0 && ws->is_warm && !ws->is_done)
+                ws->phase = phase_at(&ws->config, ticks_to_secs(get_ticks() - ws->start_time));
+
             // See if the workload is done
             if(!ws->is_done) {
-                if(ws->config.duration_unit == dut_space) {
+                if(!ws->is_warm) {
+                    all_done = false;
+                } else if(ws->config.duration_unit == dut_space) {
                     ops_so_far = compute_total_ops(ws);
-                    long long total_bytes = ops_so_far * ws->config.block_size;
+                    long long total_bytes = (ops_so_far - ws->warmup_ops) * ws->config.block_size;
                     if(total_bytes >= ws->config.duration) {
                         ws->is_done = 1;
                     } else {
                         all_done = false;
                     }
                 } else if(ws->config.duration_unit == dut_time) {
-                    if(total_slept / 200.0f >= ws->config.duration) {
+                    if(ticks_to_secs(get_ticks() - ws->start_time) >= ws->config.duration) {
                         ws->is_done = 1;
                     } else {
                         all_done = false;
@@ -153,47 +475,34 @@ void stop_simulations(wsp_vector *workloads) {
                 // If sample step is zero, we're dealing with
                 // latencies for any given op instead of ops per
                 // second.
-                char buf[1024];
-                int buf_offset = 0;
-                for(int i = 0; i < ws->latencies.size(); i++) {
-                    unsigned long long latency = ws->latencies[i];
-                    ws->sum_latency += latency;
-                    add_to_std_dev(&(ws->std_dev), latency);
-                    if(latency < ws->min_latency)
-                        ws->min_latency = latency;
-                    if(latency > ws->max_latency)
-                        ws->max_latency = latency;
-                    if(ws->output_fd != -1) {
-                        int _off = snprintf(buf + buf_offset, sizeof(buf) - buf_offset,
-                                            "%.2f\n", ticks_to_us(latency));
-                        if(_off >= sizeof(buf) - buf_offset) {
-                            // Couldn't write everything, flush and write
-                            // again.
-                            int res = write(ws->output_fd, buf, buf_offset);
-                            check("Could not record output data", res != buf_offset);
-                            buf_offset = 0;
-                            _off = snprintf(buf + buf_offset, sizeof(buf) - buf_offset,
-                                            "%.2f\n", ticks_to_us(latency));
-                        }
-                        buf_offset += _off;
-                    }
-                }
-                if(ws->output_fd != -1) {
-                    // Write whatever we missed
-                    int res = write(ws->output_fd, buf, buf_offset);
-                    check("Could not record output data", res != buf_offset);
-                }
-                ws->latencies.clear();
+                drain_latencies(ws);
             } else {
                 ticks_now = get_ticks();
                 unsigned long long ms_passed = ticks_to_ms(ticks_now - last_ticks_now);
-                if(ms_passed >= ws->config.sample_step) {
+                // A phased workload that just finished also gets its final
+                // partial interval, so the last phase isn't dropped
+                bool last_sample = ws->config.phase_count != 0 && ws->is_done &&
+                    !ws->is_joined && ms_passed > 0;
+                if(ms_passed >= ws->config.sample_step && !last_sample &&
+                   ws->start_time > last_ticks_now) {
+                    // The warmup ended within this step, the intervals
+                    // start from the next one
+                    if(ops_so_far == -1) {
+                        ops_so_far = compute_total_ops(ws);
+                    }
+                    ws->last_ops_so_far = ops_so_far;
+                    check("Could not lock latency mutex", pthread_mutex_lock(&ws->latency_mutex) != 0);
+                    ws->stream_stat->snapshot_and_reset();
+                    check("Could not unlock latency mutex", pthread_mutex_unlock(&ws->latency_mutex) != 0);
+                } else if(ms_passed >= ws->config.sample_step || last_sample) {
                     // Compute current stats
                     if(ops_so_far == -1) {
                         ops_so_far = compute_total_ops(ws);
                     }
+                    // A final interval right after the warmup only counts from its end
+                    float secs_measured = ticks_to_secs(ticks_now - std::max(last_ticks_now, ws->start_time));
                     unsigned long long ops_this_time = ops_so_far - ws->last_ops_so_far;
-                    int ops_per_sec = (float)ops_this_time / ((float)ms_passed / 1000.0f);
+                    int ops_per_sec = (float)ops_this_time / secs_measured;
                     ws->last_ops_so_far = ops_so_far;
 
                     if(ops_per_sec < ws->min_ops_per_sec)
@@ -201,16 +510,63 @@ void stop_simulations(wsp_vector *workloads) {
                     if(ops_per_sec > ws->max_ops_per_sec)
                         ws->max_ops_per_sec = ops_per_sec;
                     add_to_std_dev(&(ws->std_dev), ops_per_sec);
+                    // Tag the interval with the phase it spent most of its time in
+                    interval_stat_t interval = { ticks_now - ws->start_time, ops_per_sec,
+                                                 ops_so_far - ws->warmup_ops,
+                                                 phase_at(&ws->config, ticks_to_secs(ticks_now - ws->start_time) - secs_measured / 2) };
+                    ws->intervals.push_back(interval);
+
+                    if(ws->output_fd != -1 || ws->histogram_fd != -1 || metrics ||
+                       ws->config.steady_state_rounds != 0) {
+                        check("Could not lock latency mutex", pthread_mutex_lock(&ws->latency_mutex) != 0);
+			ws->stream_stat->snapshot_and_reset();			
+                        check("Could not unlock latency mutex", pthread_mutex_unlock(&ws->latency_mutex) != 0);
+                    }
+
+                    if(metrics)
+                        publish_metrics(metrics, ws->metrics_slot, ws, ops_so_far, ops_per_sec);
+
+                    if(ws->histogram_fd != -1) {
+                        std::vector<unsigned char> histogram;
+                        ws->stream_stat->serialize_snapshot(histogram);
+                        write_histogram_record(ws->histogram_fd, hrt_interval, ticks_now, histogram);
+                    }
+
+                    if(ws->config.steady_state_rounds != 0 && ws->is_warm && !ws->is_done) {
+                        ws->round_histograms.push_back(std::vector<unsigned char>());
+                        ws->stream_stat->serialize_snapshot(ws->round_histograms.back());
+                        if(ws->round_histograms.size() > ws->config.steady_state_rounds)
+                            ws->round_histograms.pop_front();
+                        if(check_steady_state(ws))
+                            ws->is_done = 1;
+                    }
 
                     if(ws->output_fd != -1) {
 			int buffer_size = 1024;
                         char databuf[buffer_size];
-			ws->stream_stat->snapshot_and_reset();			
 			stat_data_t stat_data = ws->stream_stat->get_snapshot_stat();			
                         int outcount = snprintf(databuf, buffer_size, "%lld\t%d\t%.1f\t%lld\t%lld", ticks_now, ops_per_sec, stat_data.mean, stat_data.min_value, stat_data.max_value);
 			for(std::map<double, ticks_t>::iterator it = stat_data.percentiles.begin(); it != stat_data.percentiles.end(); ++it) {
 				outcount += snprintf(databuf+outcount, buffer_size-outcount, "\t%lld", it->second);	
 			}
+			if(ws->device_stats) {
+				disk_counters_t device_now;
+				ws->device_stats->sample(&device_now);
+				disk_rates_t rates = device_stats_t::compute_rates(ws->device_last, device_now);
+				ws->device_last = device_now;
+				outcount += snprintf(databuf+outcount, buffer_size-outcount,
+						     "\t%.1f\t%.1f\t%.1f\t%.1f\t%.2f\t%.2f\t%.2f\t%.1f\t%.3f\t%.3f",
+						     rates.reads_per_sec, rates.writes_per_sec,
+						     rates.read_merges_per_sec, rates.write_merges_per_sec,
+						     rates.read_mb_per_sec, rates.write_mb_per_sec,
+						     rates.avg_queue_size, rates.utilization,
+						     rates.read_await_ms, rates.write_await_ms);
+			}
+			if(ws->config.phase_count != 0)
+				outcount += snprintf(databuf+outcount, buffer_size-outcount, "\t%s",
+						     ws->config.phases[interval.phase].name);
+			if(ws->output_tag)
+				outcount += snprintf(databuf+outcount, buffer_size-outcount, "\t%s", ws->output_tag);
 			outcount += snprintf(databuf+outcount, buffer_size-outcount, "\n");
                         int res = write(ws->output_fd, databuf, outcount);
                         check("Could not record output data", res != outcount);
@@ -219,12 +575,21 @@ void stop_simulations(wsp_vector *workloads) {
             }
             
             // If the workload is done, wait for all the threads and grab the time
-            if(ws->is_done) {
+            if(ws->is_done && !ws->is_joined) {
                 for(int i = 0; i < ws->config.threads; i++) {
                     check("Error joining thread",
                           pthread_join(ws->threads[i], NULL) != 0);
                 }
                 ws->end_time = get_ticks();
+                ws->run_end_time = ws->end_time;
+                if(ws->device_stats)
+                    ws->device_stats->sample(&ws->device_end);
+                set_timing_window(ws);
+                if(ws->trace_writer)
+                    ws->trace_writer->stop();
+                if(ws->config.sample_step == 0)
+                    drain_latencies(ws);
+                ws->is_joined = 1;
             }
         }
         
@@ -237,44 +602,371 @@ void stop_simulations(wsp_vector *workloads) {
                 
         if(!all_done) {
             usleep(5000);
-            total_slept++;
         }
     }
 }
 
-void compute_stats(wsp_vector *workloads) {
+void collect_stats(workload_simulation_t *ws) {
+    for(int i = 0; i < ws->config.threads; i++) {
+        // Clean up local fds
+        if(ws->config.local_fd)
+            cleanup_io(&ws->config, ws, ws->engines[i]);
+    }
+    ws->total_ops = compute_total_ops(ws);
+    ws->ops = ws->steady_state ? ws->steady_ops : ws->total_ops - ws->warmup_ops;
+    
+    if(!ws->config.local_fd)
+        cleanup_io(&ws->config, ws, ws->engines[0]);
+    if(ws->output_fd != -1) {
+        check("Could not close the output file", close(ws->output_fd) == -1);
+        ws->output_fd = -1;
+    }
+
+    if(ws->config.sample_step == 0) {
+        ws->sum_latency = ws->latencies->sum_latency;
+        ws->min_latency = ws->latencies->min_latency;
+        ws->max_latency = ws->latencies->max_latency;
+        ws->std_dev = ws->latencies->std_dev;
+    }
+}
+
+void destroy_simulation(workload_simulation_t *ws) {
+    for(int i = 0; i < ws->engines.size(); i++) {
+        // Pools sharing the fds of the first one are left
+        if(ws->engines[i]->file_pool)
+            delete ws->engines[i]->file_pool;
+        delete ws->engines[i];	  
+    }	
+    if(ws->file_set)
+        delete ws->file_set;
+    delete ws->stream_stat;
+    delete ws->flush_stat;
+    for(int i = 0; i < mop_count; i++) {
+        if(ws->meta_stats[i])
+            delete ws->meta_stats[i];
+    }
+    for(int i = 0; i < pst_count; i++) {
+        if(ws->step_stats[i])
+            delete ws->step_stats[i];
+    }
+    if(ws->trace_writer)
+        delete ws->trace_writer;
+    if(ws->latencies)
+        delete ws->latencies;
+    if(ws->device_stats)
+        delete ws->device_stats;
+    pthread_mutex_destroy(&ws->latency_mutex);
+    delete ws;
+}
+
+void compute_stats(wsp_vector *workloads, std::vector<std::vector<run_result_t> > *results) {
     // Compute the stats
     for(wsp_vector::iterator it = workloads->begin(); it != workloads->end(); ++it) {
         workload_simulation_t *ws = *it;
-        for(int i = 0; i < ws->config.threads; i++) {
-            // Clean up local fds
-            if(ws->config.local_fd)
-                cleanup_io(&ws->config, ws, ws->engines[i]);
-        }
-        ws->ops = compute_total_ops(ws);
-        
-        if(!ws->config.local_fd)
-            cleanup_io(&ws->config, ws, ws->engines[0]);
+        collect_stats(ws);
+        (*results)[it - workloads->begin()].push_back(get_run_result(ws));
 
         // print results
-        if(it != workloads->begin())
+        if(ws->config.format != ofm_text) {
+            print_report(ws);
+        } else {
+            if(it != workloads->begin())
+                printf("---\n");
+            print_status(ws->config.device_length, &ws->config);
+            print_stats(ws->start_time, ws->end_time, ws->ops, compute_op_bytes(ws),
+                        &ws->config,
+                        ws->min_ops_per_sec, ws->max_ops_per_sec,
+                        sqrt(get_variance(&(ws->std_dev))),
+                        ws->sum_latency, ws->min_latency, ws->max_latency);	
+            print_warmup_stats(&ws->config, ws->warmup_ops, ws->warmup_ticks);
+            print_steady_state_stats(&ws->config, ws->steady_state,
+                                     ws->steady_end_time - ws->run_start_time - ws->warmup_ticks);
+            cpu_stat_t cpu_stat = compute_cpu_stats(ws);
+            print_cpu_stats(&ws->config, ws->run_start_time, ws->run_end_time, ws->total_ops, &cpu_stat);
+            print_harness_stats(&ws->config, ws->start_time, ws->end_time, ws->ops, ws->harness_ops_per_sec);
+            print_latency_stats(&ws->config,
+                                ws->config.operation == op_trim ? "Trim latency statistics" : "Latency statistics",
+                                ws->stream_stat->get_global_stat());
+            stat_data_t flush_data = ws->flush_stat->get_global_stat();
+            if(flush_data.count > 0) {
+                print_latency_stats(&ws->config,
+                                    ws->config.operation == op_trim ? "Trim command latency statistics" : "Flush latency statistics",
+                                    flush_data);
+            }
+            for(int i = 0; i < mop_count; i++) {
+                if(ws->meta_stats[i] == NULL || ws->meta_stats[i]->get_global_stat().count == 0)
+                    continue;
+                char title[64];
+                snprintf(title, sizeof(title), "Latency statistics of %s", meta_op_name((meta_op_t)i));
+                print_latency_stats(&ws->config, title, ws->meta_stats[i]->get_global_stat());
+            }
+            for(int i = 0; i < pst_count; i++) {
+                if(ws->step_stats[i] == NULL || ws->step_stats[i]->get_global_stat().count == 0)
+                    continue;
+                char title[64];
+                snprintf(title, sizeof(title), "Latency statistics of %s steps",
+                         pattern_step_name((pattern_step_t)i));
+                print_latency_stats(&ws->config, title, ws->step_stats[i]->get_global_stat());
+            }
+
+            print_device_stats(&ws->config, ws->device_stats, &ws->device_start, &ws->device_end);
+            print_fault_stats(&ws->config, cpu_stat.major_faults, cpu_stat.minor_faults);
+            print_file_set_stats(&ws->config, ws->file_set, compute_file_opens(ws), ws->total_ops);
+            print_object_stats(&ws->config, compute_op_bytes(ws));
+            print_trace_stats(&ws->config, ws->trace_writer);
+            print_capture_stats(&ws->config, ws->latencies);
+            if(ws->config.operation == op_trim) {
+                long trim_commands = 0;
+                for(int i = 0; i < ws->engines.size(); i++)
+                    trim_commands += ws->engines[i]->trim_commands;
+                print_trim_stats(&ws->config, ws->start_time, ws->end_time, ws->ops, trim_commands);
+            }
+        }
+
+        if(ws->histogram_fd != -1) {
+            std::vector<unsigned char> histogram;
+            ws->stream_stat->serialize_global(histogram);
+            write_histogram_record(ws->histogram_fd, hrt_total, ws->end_time, histogram);
+            check("Could not close the histogram file", close(ws->histogram_fd) == -1);
+        }
+
+        destroy_simulation(ws);
+    }
+}
+
+void read_precondition_state(const char *path, int *passes, int *random_done) {
+    *passes = 0;
+    *random_done = 0;
+    if(path[0] == 0)
+        return;
+    FILE *file = fopen(path, "r");
+    if(file == NULL)
+        return; // nothing finished yet
+    int res = fscanf(file, "passes %d random %d", passes, random_done);
+    fclose(file);
+    check("Invalid preconditioning state file", res != 2);
+}
+
+void write_precondition_state(const char *path, int passes, int random_done) {
+    if(path[0] == 0)
+        return;
+    // Replace the file in one step so an interruption can't leave half of it
+    std::string tmp_path = std::string(path) + ".tmp";
+    FILE *file = fopen(tmp_path.c_str(), "w");
+    check("Could not write the preconditioning state", file == NULL);
+    fprintf(file, "passes %d random %d\n", passes, random_done);
+    check("Could not write the preconditioning state", fflush(file) != 0 || fsync(fileno(file)) != 0);
+    fclose(file);
+    check("Could not write the preconditioning state", rename(tmp_path.c_str(), path) != 0);
+}
+
+void suffix_run_file(char *file_name, int run) {
+    // Each run of a --repeat writes its own file, NAME.1, NAME.2, ...
+    if(file_name[0] == 0)
+        return;
+    char buf[DEVICE_NAME_LENGTH];
+    int len = snprintf(buf, sizeof(buf), "%s.%d", file_name, run + 1);
+    check("File name too long", len >= sizeof(buf));
+    strcpy(file_name, buf);
+}
+
+void pick_precondition_engine(workload_config_t *step) {
+    // Native AIO with direct IO is the fastest. Targets rejecting O_DIRECT
+    // (tmpfs, some FUSE filesystems) and kernels without native AIO get
+    // POSIX AIO instead.
+    int fd = open64(step->device, O_WRONLY | O_DIRECT);
+    check("Error opening device", fd == -1 && errno != EINVAL);
+    step->direct_io = fd != -1;
+    if(fd != -1)
+        close(fd);
+    io_context_t ctx = 0;
+    bool native_aio = io_setup(step->queue_depth, &ctx) == 0;
+    if(native_aio)
+        io_destroy(ctx);
+    step->io_type = native_aio && step->direct_io ? iot_naio : iot_paio;
+}
+
+void sync_precondition_step(workload_config_t *step) {
+    // Paged writes only reach the device once flushed
+    if(step->direct_io)
+        return;
+    int fd = open64(step->device, O_WRONLY);
+    check("Error opening device", fd == -1);
+    check("Error syncing data", fdatasync(fd) == -1);
+    close(fd);
+}
+
+workload_simulation_t* run_precondition_step(workload_config_t *config, int metrics_slot,
+                                             metrics_server_t *metrics, int output_append) {
+    workload_simulation_t *ws = new workload_simulation_t();
+    ws->config = *config;
+    ws->metrics_slot = metrics_slot;
+    ws->output_tag = "precondition";
+    ws->output_append = output_append;
+    wsp_vector step(1, ws);
+    pthread_barrier_t start_barrier;
+    start_simulations(&step, &start_barrier);
+    stop_simulations(&step, metrics);
+    pthread_barrier_destroy(&start_barrier);
+    collect_stats(ws);
+    return ws;
+}
+
+void precondition_workload(workload_simulation_t *ws, metrics_server_t *metrics, int repeat) {
+    workload_config_t *config = &ws->config;
+    int passes_done, random_done;
+    read_precondition_state(config->precondition_state, &passes_done, &random_done);
+    check("The preconditioning state has more passes than requested",
+          passes_done > config->precondition_passes);
+    bool verbose = !config->silent && config->format == ofm_text;
+
+    // Writes only, on the fastest engine. Of the workload's outputs only
+    // --output is kept, its lines are tagged and the run appends to them.
+    workload_config_t step = *config;
+    step.operation = op_write;
+    step.queue_depth = PRECONDITION_QUEUE_DEPTH;
+    pick_precondition_engine(&step);
+    step.use_eventfd = 0;
+    step.threads = 1;
+    step.local_fd = 0;
+    step.buffered = 0;
+    step.append_only = 0;
+    step.direction = opd_forward;
+    step.dist = rdt_uniform;
+    step.pause_interval = 0;
+    step.warmup = 0;
+    step.phase_count = 0;
+    step.pattern = pat_none;
+    if(repeat > 1)
+        suffix_run_file(step.output_file, 0);
+    step.trace_file[0] = 0;
+    step.histogram_file[0] = 0;
+    step.device_stats = 0;
+    step.perf = 0;
+    step.silent = 1;
+    step.precondition_passes = -1;
+    if(step.sample_step == 0)
+        step.sample_step = 1000;
+
+    // Sequential passes over the whole range
+    step.workload = wl_seq;
+    step.fill = 1;
+    step.block_size = std::min((off64_t)PRECONDITION_FILL_BLOCK_SIZE, config->length);
+    step.stride = step.block_size;
+    step.length = config->length / step.block_size * step.block_size;
+    step.duration_unit = dut_space;
+    step.duration = step.length;
+    step.steady_state_rounds = 0;
+    for(int pass = passes_done; pass < config->precondition_passes; pass++) {
+        if(verbose) {
+            printf("Preconditioning: sequential pass %d of %d...", pass + 1, config->precondition_passes);
+            fflush(stdout);
+        }
+        workload_simulation_t *step_ws = run_precondition_step(&step, ws->metrics_slot, metrics, ws->output_append);
+        if(verbose)
+            printf(" %.2f MB/sec\n", ((double)step_ws->ops * step.block_size / 1024 / 1024) /
+                   ticks_to_secs(step_ws->end_time - step_ws->start_time));
+        destroy_simulation(step_ws);
+        sync_precondition_step(&step);
+        ws->output_append = step.output_file[0] != 0;
+        write_precondition_state(config->precondition_state, pass + 1, 0);
+    }
+
+    // Then random writes until steady state
+    if(random_done)
+        return;
+    step.workload = wl_rnd;
+    step.fill = 0;
+    step.block_size = config->precondition_block_size;
+    step.stride = step.block_size;
+    step.length = config->length / step.block_size * step.block_size;
+    step.duration_unit = dut_time;
+    step.duration = config->precondition_time;
+    step.steady_state_rounds = PRECONDITION_ROUNDS;
+    if(verbose) {
+        printf("Preconditioning: random writes until steady state...");
+        fflush(stdout);
+    }
+    workload_simulation_t *step_ws = run_precondition_step(&step, ws->metrics_slot, metrics, ws->output_append);
+    if(verbose) {
+        float secs = ticks_to_secs(step_ws->run_end_time - step_ws->run_start_time);
+        if(step_ws->steady_state)
+            printf(" reached after %.2f secs, %d ops/sec\n", secs,
+                   (int)(step_ws->ops / ticks_to_secs(step_ws->end_time - step_ws->start_time)));
+        else
+            printf(" not reached in %.2f secs\n", secs);
+    }
+    destroy_simulation(step_ws);
+    sync_precondition_step(&step);
+    ws->output_append = step.output_file[0] != 0;
+    write_precondition_state(config->precondition_state, config->precondition_passes, 1);
+}
+
+void precondition_workloads(wsp_vector *workloads, metrics_server_t *metrics, int repeat) {
+    for(wsp_vector::iterator it = workloads->begin(); it != workloads->end(); ++it) {
+        if((*it)->config.precondition_passes != -1)
+            precondition_workload(*it, metrics, repeat);
+    }
+}
+
+int get_repeat(wsp_vector *workloads) {
+    // The workloads run together, so they are repeated together
+    int repeat = 1;
+    for(wsp_vector::iterator it = workloads->begin(); it != workloads->end(); ++it)
+        repeat = std::max(repeat, (*it)->config.repeat);
+    return repeat;
+}
+
+void run_workloads(wsp_vector *prototypes, metrics_server_t *metrics, int run, int repeat,
+                   std::vector<std::vector<run_result_t> > *results) {
+    // Every run starts from a copy of the parsed and calibrated workloads
+    wsp_vector workloads;
+    for(wsp_vector::iterator it = prototypes->begin(); it != prototypes->end(); ++it) {
+        workload_simulation_t *ws = new workload_simulation_t(**it);
+        if(repeat > 1) {
+            suffix_run_file(ws->config.output_file, run);
+            suffix_run_file(ws->config.histogram_file, run);
+            suffix_run_file(ws->config.trace_file, run);
+        }
+        // Only the first run follows the preconditioning lines
+        if(run > 0)
+            ws->output_append = 0;
+        workloads.push_back(ws);
+    }
+
+    workload_config_t *config = &workloads[0]->config;
+    if(repeat > 1 && !config->silent && config->format == ofm_text) {
+        if(run > 0)
+            printf("===\n");
+        printf("Run %d of %d\n", run + 1, repeat);
+    }
+    if(run > 0)
+        drop_workload_caches(&workloads);
+
+    pthread_barrier_t start_barrier;
+    start_simulations(&workloads, &start_barrier);
+    stop_simulations(&workloads, metrics);
+    pthread_barrier_destroy(&start_barrier);
+    compute_stats(&workloads, results);
+}
+
+int summarize_workloads(wsp_vector *workloads, std::vector<std::vector<run_result_t> > *results) {
+    // Returns the number of regressions against the baselines
+    int regressions = 0;
+    for(int i = 0; i < workloads->size(); i++) {
+        workload_config_t *config = &(*workloads)[i]->config;
+        std::vector<run_summary_t> summaries;
+        summarize_runs((*results)[i], summaries);
+        if(config->baseline_file[0] != 0)
+            regressions += compare_to_baseline(config->baseline_file, i + 1, summaries);
+        if(config->format == ofm_text && !config->silent)
             printf("---\n");
-        print_status(ws->config.device_length, &ws->config);
-        print_stats(ws->start_time, ws->end_time, ws->ops,
-                    &ws->config,
-                    ws->min_ops_per_sec, ws->max_ops_per_sec,
-                    sqrt(get_variance(&(ws->std_dev))),
-                    ws->sum_latency, ws->min_latency, ws->max_latency);	
-	print_latency_stats(&ws->config, ws->stream_stat->get_global_stat());
-
-        // clean up
-        for(int i = 0; i < ws->engines.size(); i++) {
-            delete ws->engines[i];	  
-	}	
-	delete ws->stream_stat;
-        pthread_mutex_destroy(&ws->latency_mutex);
-        delete ws;
+        print_run_summary(config, i + 1, summaries);
     }
+    if(regressions > 0)
+        fprintf(stderr, "%d significant regression%s against the baseline\n",
+                regressions, regressions > 1 ? "s" : "");
+    return regressions;
 }
 
 int main(int argc, char *argv[])
@@ -283,7 +975,18 @@ int main(int argc, char *argv[])
 
     parse_workloads(argc, argv, &workloads);
     drop_workload_caches(&workloads);
-    start_simulations(&workloads);
-    stop_simulations(&workloads);
-    compute_stats(&workloads);
+    init_clock_source(&workloads);
+    metrics_server_t *metrics = start_metrics_server(&workloads);
+    int repeat = get_repeat(&workloads);
+    precondition_workloads(&workloads, metrics, repeat);
+    calibrate_workloads(&workloads);
+    std::vector<std::vector<run_result_t> > results(workloads.size());
+    for(int run = 0; run < repeat; run++)
+        run_workloads(&workloads, metrics, run, repeat, &results);
+    if(metrics) {
+        metrics->stop();
+        delete metrics;
+    }
+    if(repeat > 1 && summarize_workloads(&workloads, &results) > 0)
+        return 2;
 }
@@ -0,0 +1,308 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <gsl/gsl_cdf.h>
+#include "repeat.hpp"
+
+// One-sided significance level of a regression against the baseline,
+// over all the metrics compared
+#define BASELINE_SIGNIFICANCE 0.05
+
+run_result_t get_run_result(workload_simulation_t *ws) {
+    run_result_t result;
+    result.ops_per_sec = ws->ops / ticks_to_secs(ws->end_time - ws->start_time);
+    stat_data_t stat_data = ws->stream_stat->get_global_stat();
+    result.mean_latency = stat_data.count == 0 ? 0 : stat_data.mean;
+    if(stat_data.count > 0)
+        result.percentiles = stat_data.percentiles;
+    return result;
+}
+
+static run_summary_t summarize(const char *name, const char *label, int higher_is_better,
+                               std::vector<double> &values) {
+    run_summary_t summary;
+    summary.name = name;
+    summary.label = label;
+    summary.higher_is_better = higher_is_better;
+    summary.runs = values.size();
+    summary.has_baseline = 0;
+    summary.baseline_mean = 0;
+    summary.regression = 0;
+
+    double sum = 0;
+    for(int i = 0; i < values.size(); i++)
+        sum += values[i];
+    summary.mean = sum / values.size();
+    double squares = 0;
+    for(int i = 0; i < values.size(); i++)
+        squares += (values[i] - summary.mean) * (values[i] - summary.mean);
+    summary.stddev = values.size() > 1 ? sqrt(squares / (values.size() - 1)) : 0;
+
+    // Student's t interval, the runs are too few for the normal one
+    double half_width = 0;
+    if(values.size() > 1)
+        half_width = gsl_cdf_tdist_Pinv(0.975, values.size() - 1) * summary.stddev / sqrt((double)values.size());
+    summary.ci_low = summary.mean - half_width;
+    summary.ci_high = summary.mean + half_width;
+    return summary;
+}
+
+void summarize_runs(std::vector<run_result_t> &results, std::vector<run_summary_t> &summaries) {
+    std::vector<double> values;
+    for(int i = 0; i < results.size(); i++)
+        values.push_back(results[i].ops_per_sec);
+    summaries.push_back(summarize("ops_per_sec", "Ops/sec", 1, values));
+
+    values.clear();
+    for(int i = 0; i < results.size(); i++)
+        values.push_back(results[i].mean_latency / 1000.0);
+    summaries.push_back(summarize("latency_mean_us", "Mean latency", 0, values));
+
+    // Every run uses the same marks, runs without ops have none
+    std::map<double, ticks_t> *marks = NULL;
+    for(int i = 0; i < results.size() && marks == NULL; i++) {
+        if(!results[i].percentiles.empty())
+            marks = &results[i].percentiles;
+    }
+    if(marks == NULL)
+        return;
+    for(std::map<double, ticks_t>::iterator it = marks->begin(); it != marks->end(); ++it) {
+        values.clear();
+        for(int i = 0; i < results.size(); i++) {
+            if(results[i].percentiles.count(it->first))
+                values.push_back(ticks_to_us(results[i].percentiles[it->first]));
+        }
+        char name[64], label[64];
+        snprintf(name, sizeof(name), "latency_p%g_us", it->first * 100);
+        snprintf(label, sizeof(label), "%gth percentile latency", it->first * 100);
+        summaries.push_back(summarize(name, label, 0, values));
+    }
+}
+
+/**
+ * Baseline
+ **/
+// Just enough JSON to read rebench's own output back: every number of
+// an object is flattened into a map keyed by its dotted path
+static void skip_space(const char *&p) {
+    while(*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        p++;
+}
+
+static bool parse_json_string(const char *&p, std::string *out) {
+    if(*p != '"')
+        return false;
+    for(p++; *p && *p != '"'; p++) {
+        if(*p == '\\') {
+            p++;
+            if(*p == 0)
+                return false;
+            if(*p == 'u') {
+                // Only ever used for control characters
+                if(strlen(p) < 5)
+                    return false;
+                *out += (char)strtol(std::string(p + 1, 4).c_str(), NULL, 16);
+                p += 4;
+                continue;
+            }
+            const char *escapes = "bfnrt", *chars = "\b\f\n\r\t";
+            const char *escape = strchr(escapes, *p);
+            *out += escape ? chars[escape - escapes] : *p;
+        } else {
+            *out += *p;
+        }
+    }
+    if(*p != '"')
+        return false;
+    p++;
+    return true;
+}
+
+static bool parse_json_value(const char *&p, const std::string &path, std::map<std::string, double> &numbers) {
+    skip_space(p);
+    if(*p == '{' || *p == '[') {
+        char close = *p == '{' ? '}' : ']';
+        p++;
+        skip_space(p);
+        if(*p == close) {
+            p++;
+            return true;
+        }
+        for(int i = 0; ; i++) {
+            std::string key;
+            skip_space(p);
+            if(close == '}') {
+                if(!parse_json_string(p, &key))
+                    return false;
+                skip_space(p);
+                if(*p++ != ':')
+                    return false;
+            } else {
+                char index[16];
+                snprintf(index, sizeof(index), "%d", i);
+                key = index;
+            }
+            if(!parse_json_value(p, path.empty() ? key : path + "." + key, numbers))
+                return false;
+            skip_space(p);
+            if(*p == close) {
+                p++;
+                return true;
+            }
+            if(*p++ != ',')
+                return false;
+        }
+    } else if(*p == '"') {
+        std::string value;
+        return parse_json_string(p, &value);
+    } else if(strncmp(p, "null", 4) == 0 || strncmp(p, "true", 4) == 0) {
+        p += 4;
+        return true;
+    } else if(strncmp(p, "false", 5) == 0) {
+        p += 5;
+        return true;
+    }
+    char *end;
+    double value = strtod(p, &end);
+    if(end == p)
+        return false;
+    numbers[path] = value;
+    p = end;
+    return true;
+}
+
+int compare_to_baseline(const char *baseline_file, int workload, std::vector<run_summary_t> &summaries) {
+    FILE *file = fopen(baseline_file, "r");
+    check("Could not open the baseline", file == NULL);
+
+    // Find the summary of the workload among the lines
+    std::map<std::string, double> baseline;
+    char *line = NULL;
+    size_t line_size = 0;
+    bool found = false;
+    while(!found && getline(&line, &line_size, file) != -1) {
+        if(line[0] != '{')
+            continue;
+        baseline.clear();
+        const char *p = line;
+        check("Could not parse the baseline", !parse_json_value(p, "", baseline));
+        found = baseline.count("runs") && baseline.count("workload") && baseline["workload"] == workload;
+    }
+    free(line);
+    fclose(file);
+    check("The baseline has no summary for the workload (use the JSON output of a --repeat run)", !found);
+    int baseline_runs = baseline["runs"];
+    check("The baseline needs at least 2 runs", baseline_runs < 2);
+
+    // Welch's t-test, the variances of the two sides needn't be the same
+    std::vector<double> p_values(summaries.size(), 1);
+    int compared = 0;
+    for(int i = 0; i < summaries.size(); i++) {
+        run_summary_t *summary = &summaries[i];
+        std::string key = "summary." + summary->name + ".";
+        if(!baseline.count(key + "mean") || !baseline.count(key + "stddev") || summary->runs < 2)
+            continue;
+        double baseline_stddev = baseline[key + "stddev"];
+        summary->has_baseline = 1;
+        summary->baseline_mean = baseline[key + "mean"];
+        compared++;
+
+        // How much worse the runs are, positive if worse
+        double worse = summary->higher_is_better ?
+            summary->baseline_mean - summary->mean : summary->mean - summary->baseline_mean;
+        double var = summary->stddev * summary->stddev / summary->runs;
+        double baseline_var = baseline_stddev * baseline_stddev / baseline_runs;
+        if(var + baseline_var == 0) {
+            p_values[i] = worse > 0 ? 0 : 1;
+        } else {
+            double t = worse / sqrt(var + baseline_var);
+            double df = (var + baseline_var) * (var + baseline_var) /
+                (var * var / (summary->runs - 1) + baseline_var * baseline_var / (baseline_runs - 1));
+            p_values[i] = gsl_cdf_tdist_Q(t, df);
+        }
+    }
+
+    // Bonferroni correction, or testing a dozen percentiles would flag
+    // one of them on noise alone every other run
+    int regressions = 0;
+    for(int i = 0; i < summaries.size(); i++) {
+        summaries[i].regression = summaries[i].has_baseline &&
+            p_values[i] < BASELINE_SIGNIFICANCE / compared;
+        regressions += summaries[i].regression;
+    }
+    return regressions;
+}
+
+/**
+ * Output
+ **/
+static void print_summary_text(workload_config_t *config, std::vector<run_summary_t> &summaries) {
+    printf("Summary of %d runs (mean, sample stddev and 95%% confidence interval):\n", summaries[0].runs);
+    for(int i = 0; i < summaries.size(); i++) {
+        run_summary_t *summary = &summaries[i];
+        // Latencies in us with more precision
+        const char *format = summary->higher_is_better ? "%.1f" : "%.3f";
+        const char *unit = summary->higher_is_better ? "" : " us";
+        printf("%s: mean - ", summary->label.c_str());
+        printf(format, summary->mean);
+        printf("%s, stddev - ", unit);
+        printf(format, summary->stddev);
+        printf("%s (%.2f%%), 95%% CI - [", unit, summary->mean == 0 ? 0 : summary->stddev / summary->mean * 100);
+        printf(format, summary->ci_low);
+        printf(", ");
+        printf(format, summary->ci_high);
+        printf("]%s", unit);
+        if(summary->has_baseline) {
+            printf(" | baseline - ");
+            printf(format, summary->baseline_mean);
+            printf("%s (%+.2f%%)%s", unit,
+                   summary->baseline_mean == 0 ? 0 : (summary->mean / summary->baseline_mean - 1) * 100,
+                   summary->regression ? ", REGRESSION" : "");
+        }
+        printf("\n");
+    }
+}
+
+static void print_summary_json(int workload, std::vector<run_summary_t> &summaries) {
+    printf("{\"workload\": %d, \"runs\": %d, \"summary\": {", workload, summaries[0].runs);
+    for(int i = 0; i < summaries.size(); i++) {
+        run_summary_t *summary = &summaries[i];
+        printf("%s\"%s\": {\"mean\": %.3f, \"stddev\": %.3f, \"ci95_low\": %.3f, \"ci95_high\": %.3f, ",
+               i > 0 ? ", " : "", summary->name.c_str(),
+               summary->mean, summary->stddev, summary->ci_low, summary->ci_high);
+        if(summary->has_baseline)
+            printf("\"baseline_mean\": %.3f, \"regression\": %d}", summary->baseline_mean, summary->regression);
+        else
+            printf("\"baseline_mean\": null, \"regression\": null}");
+    }
+    printf("}}\n");
+}
+
+static void print_summary_csv(int workload, std::vector<run_summary_t> &summaries) {
+    // A second table after the rows of the runs
+    static bool header_printed = false;
+    if(!header_printed) {
+        printf("\nworkload,runs,metric,mean,stddev,ci95_low,ci95_high,baseline_mean,regression\n");
+        header_printed = true;
+    }
+    for(int i = 0; i < summaries.size(); i++) {
+        run_summary_t *summary = &summaries[i];
+        printf("%d,%d,%s,%.3f,%.3f,%.3f,%.3f,", workload, summary->runs, summary->name.c_str(),
+               summary->mean, summary->stddev, summary->ci_low, summary->ci_high);
+        if(summary->has_baseline)
+            printf("%.3f,%d\n", summary->baseline_mean, summary->regression);
+        else
+            printf(",\n");
+    }
+}
+
+void print_run_summary(workload_config_t *config, int workload, std::vector<run_summary_t> &summaries) {
+    if(config->format == ofm_json)
+        print_summary_json(workload, summaries);
+    else if(config->format == ofm_csv)
+        print_summary_csv(workload, summaries);
+    else if(!config->silent)
+        print_summary_text(config, summaries);
+}
@@ -0,0 +1,44 @@
+#ifndef __REPEAT_HPP__
+#define __REPEAT_HPP__
+
+#include <map>
+#include <string>
+#include <vector>
+#include "opts.hpp"
+#include "utils.hpp"
+#include "simulation.hpp"
+
+// What --repeat keeps of every run of a workload
+struct run_result_t {
+    double ops_per_sec;
+    double mean_latency; // ticks
+    std::map<double, ticks_t> percentiles;
+};
+
+// A metric over the runs, with its 95% confidence interval and how it
+// compares to the baseline
+struct run_summary_t {
+    std::string name; // as in the JSON summary
+    std::string label; // as in the text summary
+    int higher_is_better;
+    int runs;
+    double mean, stddev;
+    double ci_low, ci_high;
+    int has_baseline;
+    double baseline_mean;
+    int regression;
+};
+
+run_result_t get_run_result(workload_simulation_t *ws);
+void summarize_runs(std::vector<run_result_t> &results, std::vector<run_summary_t> &summaries);
+
+// Flags the metrics significantly worse than in the baseline, a file
+// holding the JSON output of an earlier --repeat run. Returns the number
+// of regressions.
+int compare_to_baseline(const char *baseline_file, int workload, std::vector<run_summary_t> &summaries);
+
+// Prints the summary of a workload (numbered from 1) in the format of
+// the config
+void print_run_summary(workload_config_t *config, int workload, std::vector<run_summary_t> &summaries);
+
+#endif // __REPEAT_HPP__
@@ -0,0 +1,474 @@
+
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "report.hpp"
+#include "io_engine.hpp"
+
+enum field_type_t {
+    fdt_number,
+    fdt_string,
+    fdt_null
+};
+
+struct report_field_t {
+    std::string name;
+    std::string value;
+    field_type_t type;
+};
+
+struct report_section_t {
+    std::string name;
+    std::vector<report_field_t> fields;
+};
+
+static void add_field(report_section_t *section, const char *name, const char *value, field_type_t type) {
+    report_field_t field;
+    field.name = name;
+    field.value = value;
+    field.type = type;
+    section->fields.push_back(field);
+}
+
+static void add_string(report_section_t *section, const char *name, const char *value) {
+    add_field(section, name, value, fdt_string);
+}
+
+static void add_null(report_section_t *section, const char *name) {
+    add_field(section, name, "", fdt_null);
+}
+
+static void add_number(report_section_t *section, const char *name, long long value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld", value);
+    add_field(section, name, buf, fdt_number);
+}
+
+static void add_number(report_section_t *section, const char *name, double value) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.3f", value);
+    add_field(section, name, buf, fdt_number);
+}
+
+static void add_latency_stats(report_section_t *section, stat_data_t stat_data) {
+    add_number(section, "count", (long long)stat_data.count);
+    if(stat_data.count == 0) {
+        add_null(section, "mean_us");
+        add_null(section, "min_us");
+        add_null(section, "max_us");
+    } else {
+        add_number(section, "mean_us", stat_data.mean / 1000.0);
+        add_number(section, "min_us", (double)ticks_to_us(stat_data.min_value));
+        add_number(section, "max_us", (double)ticks_to_us(stat_data.max_value));
+    }
+    for(std::map<double, ticks_t>::iterator it = stat_data.percentiles.begin(); it != stat_data.percentiles.end(); ++it) {
+        char name[32];
+        snprintf(name, sizeof(name), "p%g_us", it->first * 100);
+        if(stat_data.count == 0)
+            add_null(section, name);
+        else
+            add_number(section, name, (double)ticks_to_us(it->second));
+    }
+}
+
+// The phases as given to --phase, comma separated
+static std::string phase_list(workload_config_t *config) {
+    std::string res;
+    for(int i = 0; i < config->phase_count; i++) {
+        phase_t *phase = &config->phases[i];
+        char buf[PHASE_NAME_LENGTH + 64];
+        if(phase->rate == PHASE_IDLE)
+            snprintf(buf, sizeof(buf), "%s:%lld:idle", phase->name, phase->duration);
+        else if(phase->rate != 0)
+            snprintf(buf, sizeof(buf), "%s:%lld:%d", phase->name, phase->duration, phase->rate);
+        else
+            snprintf(buf, sizeof(buf), "%s:%lld", phase->name, phase->duration);
+        if(i > 0)
+            res += ",";
+        res += buf;
+    }
+    return res;
+}
+
+// The weights of the metadata ops as given to --meta-ops
+static std::string meta_op_list(workload_config_t *config) {
+    std::string res;
+    for(int i = 0; i < mop_count; i++) {
+        if(config->meta_weights[i] == 0)
+            continue;
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s:%d", meta_op_name((meta_op_t)i), config->meta_weights[i]);
+        if(!res.empty())
+            res += ",";
+        res += buf;
+    }
+    return res;
+}
+
+static void build_config_section(workload_config_t *config, report_section_t *section) {
+    const char *workloads[] = { "seq", "rnd" };
+    const char *directions[] = { "forward", "backward" };
+    const char *trim_modes[] = { "auto", "discard", "punch", "zero", "zeroout", "secdiscard" };
+    const char *latency_captures[] = { "reservoir", "ring" };
+    const char *dists[] = { "const", "uniform", "normal", "pow" };
+    const char *mmap_advices[] = { "normal", "random", "sequential", "willneed", "hugepage" };
+    const char *duration_units[] = { "time", "space", "interactive" };
+
+    section->name = "config";
+    add_string(section, "device", config->device);
+    add_number(section, "device_length", (long long)config->device_length);
+    add_number(section, "offset", (long long)config->offset);
+    add_number(section, "length", (long long)config->length);
+    add_number(section, "duration", config->duration);
+    add_string(section, "duration_unit", duration_units[config->duration_unit]);
+    add_number(section, "threads", (long long)config->threads);
+    add_number(section, "block_size", (long long)config->block_size);
+    add_number(section, "stride", (long long)config->stride);
+    add_string(section, "workload", workloads[config->workload]);
+    add_string(section, "type", io_type_name(config->io_type));
+    add_number(section, "queue_depth", (long long)config->queue_depth);
+    add_string(section, "direction", directions[config->direction]);
+    add_string(section, "operation", operation_name(config->operation));
+    add_string(section, "dist", dists[config->dist]);
+    add_number(section, "sigma", (long long)config->sigma);
+    add_number(section, "direct_io", (long long)config->direct_io);
+    add_number(section, "buffered", (long long)config->buffered);
+    add_number(section, "local_fd", (long long)config->local_fd);
+    add_number(section, "do_atime", (long long)config->do_atime);
+    add_number(section, "append", (long long)config->append_only);
+    add_number(section, "drop_caches", (long long)config->drop_caches);
+    add_number(section, "eventfd", (long long)config->use_eventfd);
+    add_number(section, "mmap_window", (long long)config->mmap_window);
+    add_number(section, "mmap_populate", (long long)config->mmap_populate);
+    add_string(section, "madvise", mmap_advices[config->mmap_advice]);
+    add_number(section, "msync_async", (long long)config->msync_async);
+    add_number(section, "msync_batch", (long long)config->msync_batch);
+    add_string(section, "trim", trim_modes[config->trim_mode]);
+    add_number(section, "trim_batch", (long long)config->trim_batch);
+    add_number(section, "sample_step", (long long)config->sample_step);
+    add_number(section, "latency_capacity", (long long)config->latency_capacity);
+    add_string(section, "latency_capture", latency_captures[config->latency_capture]);
+    add_number(section, "pause", (long long)config->pause_interval);
+    add_string(section, "copy_file", config->copy_file);
+    add_string(section, "output", config->output_file);
+    add_string(section, "trace", config->trace_file);
+    add_string(section, "histogram", config->histogram_file);
+    add_string(section, "metrics", config->metrics_address);
+    add_number(section, "perf", (long long)config->perf);
+    add_number(section, "device_stats", (long long)config->device_stats);
+    add_string(section, "clock", config->clock_source == cls_tsc ? "tsc" : "monotonic");
+    add_number(section, "calibrate", (long long)config->calibrate);
+    add_number(section, "warmup", config->warmup);
+    add_string(section, "warmup_unit", duration_units[config->warmup_unit]);
+    add_number(section, "steady_state_rounds", (long long)config->steady_state_rounds);
+    add_string(section, "phases", phase_list(config).c_str());
+    const char *file_selections[] = { "uniform", "zipf", "rr" };
+    add_number(section, "file_set", (long long)config->file_set);
+    add_string(section, "file_select", file_selections[config->file_select]);
+    add_number(section, "zipf_exponent", config->zipf_exponent);
+    add_number(section, "files_per_thread", (long long)config->files_per_thread);
+    add_number(section, "fd_cache", (long long)config->fd_cache);
+    add_string(section, "meta_ops", meta_op_list(config).c_str());
+    add_number(section, "dir_fanout", (long long)config->dir_fanout);
+    add_number(section, "dir_depth", (long long)config->dir_depth);
+    add_number(section, "meta_files", (long long)config->meta_files);
+    add_number(section, "object_min_size", (long long)config->object_min_size);
+    add_number(section, "object_max_size", (long long)config->object_max_size);
+    add_string(section, "object_size_dist", dists[config->object_size_dist]);
+    add_number(section, "object_fsync", (long long)config->object_fsync);
+    add_number(section, "object_rename", (long long)config->object_rename);
+    add_string(section, "pattern", pattern_name(config->pattern));
+    add_number(section, "journal_offset", (long long)config->journal_offset);
+    add_number(section, "repeat", (long long)config->repeat);
+    add_string(section, "baseline", config->baseline_file);
+    add_number(section, "precondition_passes", (long long)config->precondition_passes);
+    add_number(section, "precondition_block_size", (long long)config->precondition_block_size);
+    add_number(section, "precondition_time", config->precondition_time);
+    add_string(section, "precondition_state", config->precondition_state);
+}
+
+static void build_sections(workload_simulation_t *ws, std::vector<report_section_t> &sections) {
+    workload_config_t *config = &ws->config;
+    float total_secs = ticks_to_secs(ws->end_time - ws->start_time);
+
+    report_section_t section;
+    build_config_section(config, &section);
+    sections.push_back(section);
+
+    section = report_section_t();
+    section.name = "throughput";
+    add_number(&section, "ops", ws->ops);
+    add_number(&section, "secs", (double)total_secs);
+    // Nothing was measured when the warmup took the whole run
+    if(total_secs <= 0)
+        add_null(&section, "ops_per_sec");
+    else
+        add_number(&section, "ops_per_sec", (double)ws->ops / total_secs);
+    // Metadata ops move no data
+    if(config->io_type == iot_meta || total_secs <= 0)
+        add_null(&section, "mb_per_sec");
+    else
+        add_number(&section, "mb_per_sec", ((double)ws->ops * compute_op_bytes(ws) / 1024 / 1024) / total_secs);
+    if(ws->intervals.empty()) {
+        add_null(&section, "min_ops_per_sec");
+        add_null(&section, "max_ops_per_sec");
+        add_null(&section, "stddev_ops_per_sec");
+    } else {
+        add_number(&section, "min_ops_per_sec", ws->min_ops_per_sec);
+        add_number(&section, "max_ops_per_sec", ws->max_ops_per_sec);
+        add_number(&section, "stddev_ops_per_sec", (double)sqrt(get_variance(&ws->std_dev)));
+    }
+    if(ws->harness_ops_per_sec == 0)
+        add_null(&section, "harness_ops_per_sec");
+    else
+        add_number(&section, "harness_ops_per_sec", ws->harness_ops_per_sec);
+    add_number(&section, "warmup_ops", ws->warmup_ops);
+    add_number(&section, "warmup_secs", (double)ticks_to_secs(ws->warmup_ticks));
+    if(ws->config.steady_state_rounds == 0) {
+        add_null(&section, "steady_state");
+        add_null(&section, "steady_state_secs");
+    } else {
+        add_number(&section, "steady_state", (long long)ws->steady_state);
+        if(ws->steady_state)
+            add_number(&section, "steady_state_secs",
+                       (double)ticks_to_secs(ws->steady_end_time - ws->run_start_time - ws->warmup_ticks));
+        else
+            add_null(&section, "steady_state_secs");
+    }
+    sections.push_back(section);
+
+    section = report_section_t();
+    section.name = "latency";
+    add_latency_stats(&section, ws->stream_stat->get_global_stat());
+    sections.push_back(section);
+
+    stat_data_t flush_data = ws->flush_stat->get_global_stat();
+    section = report_section_t();
+    // Trim commands when trims are batched
+    section.name = "flush_latency";
+    add_latency_stats(&section, flush_data);
+    sections.push_back(section);
+
+    section = report_section_t();
+    section.name = "device";
+    const char *device_fields[] = { "name", "reads_per_sec", "writes_per_sec", "read_merges_per_sec",
+                                    "write_merges_per_sec", "read_mb_per_sec", "write_mb_per_sec",
+                                    "avg_queue_size", "utilization", "read_await_ms", "write_await_ms" };
+    if(ws->device_stats == NULL) {
+        for(int i = 0; i < sizeof(device_fields) / sizeof(device_fields[0]); i++)
+            add_null(&section, device_fields[i]);
+    } else {
+        disk_rates_t rates = device_stats_t::compute_rates(ws->device_start, ws->device_end);
+        add_string(&section, device_fields[0], ws->device_stats->get_name());
+        add_number(&section, device_fields[1], rates.reads_per_sec);
+        add_number(&section, device_fields[2], rates.writes_per_sec);
+        add_number(&section, device_fields[3], rates.read_merges_per_sec);
+        add_number(&section, device_fields[4], rates.write_merges_per_sec);
+        add_number(&section, device_fields[5], rates.read_mb_per_sec);
+        add_number(&section, device_fields[6], rates.write_mb_per_sec);
+        add_number(&section, device_fields[7], rates.avg_queue_size);
+        add_number(&section, device_fields[8], rates.utilization);
+        add_number(&section, device_fields[9], rates.read_await_ms);
+        add_number(&section, device_fields[10], rates.write_await_ms);
+    }
+    sections.push_back(section);
+
+    section = report_section_t();
+    section.name = "files";
+    if(ws->file_set == NULL) {
+        add_null(&section, "count");
+        add_null(&section, "opens");
+    } else {
+        add_number(&section, "count", (long long)ws->file_set->size());
+        add_number(&section, "opens", (long long)compute_file_opens(ws));
+    }
+    sections.push_back(section);
+
+    section = report_section_t();
+    section.name = "objects";
+    if(config->io_type != iot_object) {
+        add_null(&section, "bytes");
+        add_null(&section, "mean_size");
+    } else {
+        add_number(&section, "bytes", (long long)(ws->ops * compute_op_bytes(ws)));
+        add_number(&section, "mean_size", compute_op_bytes(ws));
+    }
+    sections.push_back(section);
+
+    section = report_section_t();
+    section.name = "metadata";
+    for(int i = 0; i < mop_count; i++) {
+        std::string op = meta_op_name((meta_op_t)i);
+        std::replace(op.begin(), op.end(), '-', '_');
+        if(ws->meta_stats[i] == NULL) {
+            add_null(&section, (op + "_count").c_str());
+            add_null(&section, (op + "_mean_us").c_str());
+            continue;
+        }
+        stat_data_t stat_data = ws->meta_stats[i]->get_global_stat();
+        add_number(&section, (op + "_count").c_str(), (long long)stat_data.count);
+        if(stat_data.count == 0)
+            add_null(&section, (op + "_mean_us").c_str());
+        else
+            add_number(&section, (op + "_mean_us").c_str(), stat_data.mean / 1000.0);
+    }
+    sections.push_back(section);
+
+    section = report_section_t();
+    section.name = "pattern";
+    for(int i = 0; i < pst_count; i++) {
+        std::string step = pattern_step_name((pattern_step_t)i);
+        if(ws->step_stats[i] == NULL) {
+            add_null(&section, (step + "_count").c_str());
+            add_null(&section, (step + "_mean_us").c_str());
+            continue;
+        }
+        stat_data_t stat_data = ws->step_stats[i]->get_global_stat();
+        add_number(&section, (step + "_count").c_str(), (long long)stat_data.count);
+        if(stat_data.count == 0)
+            add_null(&section, (step + "_mean_us").c_str());
+        else
+            add_number(&section, (step + "_mean_us").c_str(), stat_data.mean / 1000.0);
+    }
+    sections.push_back(section);
+
+    // CPU usage can't be split, it covers the whole run warmup included
+    cpu_stat_t cpu_stat = compute_cpu_stats(ws);
+    float run_secs = ticks_to_secs(ws->run_end_time - ws->run_start_time);
+    section = report_section_t();
+    section.name = "cpu";
+    add_number(&section, "user_secs", cpu_stat.user_usecs / 1000000.0);
+    add_number(&section, "system_secs", cpu_stat.system_usecs / 1000000.0);
+    // Percent of a single core, can go past 100 with multiple threads
+    if(run_secs <= 0)
+        add_null(&section, "utilization");
+    else
+        add_number(&section, "utilization", (cpu_stat.user_usecs + cpu_stat.system_usecs) / 10000.0 / run_secs);
+    if(ws->total_ops == 0)
+        add_null(&section, "us_per_op");
+    else
+        add_number(&section, "us_per_op", (double)(cpu_stat.user_usecs + cpu_stat.system_usecs) / ws->total_ops);
+    add_number(&section, "major_faults", (long long)cpu_stat.major_faults);
+    add_number(&section, "minor_faults", (long long)cpu_stat.minor_faults);
+    add_number(&section, "voluntary_switches", (long long)cpu_stat.voluntary_switches);
+    add_number(&section, "involuntary_switches", (long long)cpu_stat.involuntary_switches);
+    for(int i = 0; i < pfc_count; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "perf_%s", perf_counter_name((perf_counter_t)i));
+        if(cpu_stat.perf_values[i] == -1)
+            add_null(&section, name);
+        else
+            add_number(&section, name, cpu_stat.perf_values[i]);
+    }
+    add_number(&section, "perf_user_only", (long long)cpu_stat.perf_user_only);
+    sections.push_back(section);
+}
+
+static void print_json_string(const char *str) {
+    putchar('"');
+    for(const unsigned char *c = (const unsigned char*)str; *c; c++) {
+        if(*c == '"' || *c == '\\')
+            printf("\\%c", *c);
+        else if(*c < 0x20)
+            printf("\\u%04x", *c);
+        else
+            putchar(*c);
+    }
+    putchar('"');
+}
+
+static void print_csv_string(const char *str) {
+    putchar('"');
+    for(const char *c = str; *c; c++) {
+        if(*c == '"')
+            putchar('"');
+        putchar(*c);
+    }
+    putchar('"');
+}
+
+static void print_json(workload_simulation_t *ws, std::vector<report_section_t> &sections) {
+    printf("{");
+    for(int i = 0; i < sections.size(); i++) {
+        if(i > 0)
+            printf(", ");
+        print_json_string(sections[i].name.c_str());
+        printf(": {");
+        for(int j = 0; j < sections[i].fields.size(); j++) {
+            report_field_t *field = &sections[i].fields[j];
+            if(j > 0)
+                printf(", ");
+            print_json_string(field->name.c_str());
+            printf(": ");
+            if(field->type == fdt_string)
+                print_json_string(field->value.c_str());
+            else if(field->type == fdt_null)
+                printf("null");
+            else
+                printf("%s", field->value.c_str());
+        }
+        printf("}");
+    }
+    printf(", \"intervals\": [");
+    for(int i = 0; i < ws->intervals.size(); i++) {
+        if(i > 0)
+            printf(", ");
+        printf("{\"time_secs\": %.3f, \"ops_per_sec\": %d, \"phase\": ",
+               ticks_to_secs(ws->intervals[i].time), ws->intervals[i].ops_per_sec);
+        if(ws->config.phase_count != 0)
+            print_json_string(ws->config.phases[ws->intervals[i].phase].name);
+        else
+            printf("null");
+        printf("}");
+    }
+    printf("]}\n");
+}
+
+static void print_csv(workload_simulation_t *ws, std::vector<report_section_t> &sections) {
+    // Workloads can differ in percentiles and columns, so the header is
+    // printed again whenever it changes
+    static std::string last_header;
+    std::string header;
+    for(int i = 0; i < sections.size(); i++) {
+        for(int j = 0; j < sections[i].fields.size(); j++)
+            header += sections[i].name + "_" + sections[i].fields[j].name + ",";
+    }
+    header += "intervals";
+    if(header != last_header) {
+        printf("%s\n", header.c_str());
+        last_header = header;
+    }
+
+    for(int i = 0; i < sections.size(); i++) {
+        for(int j = 0; j < sections[i].fields.size(); j++) {
+            report_field_t *field = &sections[i].fields[j];
+            if(field->type == fdt_string)
+                print_csv_string(field->value.c_str());
+            else if(field->type == fdt_number)
+                printf("%s", field->value.c_str());
+            putchar(',');
+        }
+    }
+    // Sample steps as space separated time:ops_per_sec pairs, with
+    // :phase appended when the run has phases
+    putchar('"');
+    for(int i = 0; i < ws->intervals.size(); i++) {
+        if(i > 0)
+            putchar(' ');
+        printf("%.3f:%d", ticks_to_secs(ws->intervals[i].time), ws->intervals[i].ops_per_sec);
+        if(ws->config.phase_count != 0)
+            printf(":%s", ws->config.phases[ws->intervals[i].phase].name);
+    }
+    printf("\"\n");
+}
+
+void print_report(workload_simulation_t *ws) {
+    std::vector<report_section_t> sections;
+    build_sections(ws, sections);
+    if(ws->config.format == ofm_json)
+        print_json(ws, sections);
+    else if(ws->config.format == ofm_csv)
+        print_csv(ws, sections);
+}
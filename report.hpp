@@ -0,0 +1,11 @@
+#ifndef __REPORT_HPP__
+#define __REPORT_HPP__
+
+#include "simulation.hpp"
+
+// Prints the results of a finished workload as a single JSON object
+// (one line) or a CSV row, depending on config.format. The CSV header
+// is printed before the first row.
+void print_report(workload_simulation_t *ws);
+
+#endif // __REPORT_HPP__
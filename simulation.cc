@@ -5,6 +5,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -25,45 +26,137 @@ void setup_io(workload_config_t *config, workload_simulation_t *ws, io_engine_t
         flags |= O_APPEND;
 
     flags |= io_engine->contribute_open_flags();
-        
-    fd = open64(config->device, flags);
-    check("Error opening device", fd == -1);
+
+    if(ws->file_set) {
+        // The engine gets the fd of a file before every op
+        io_engine->file_pool = new file_pool_t(ws->file_set, config, flags, io_engine->thread_id);
+        fd = -1;
+    } else {
+        fd = open64(config->device, flags);
+        check("Error opening device", fd == -1);
+    }
 
     io_engine->fd = fd;
 
     io_engine->post_open_setup();
-
-    // Setup output file if necessary
-    if(config->output_file[0] != 0) {
-        ws->output_fd = open(config->output_file, O_CREAT | O_TRUNC | O_APPEND | O_WRONLY, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
-        check("Error opening the data file", ws->output_fd == -1);
-    }
 }
 
 void cleanup_io(workload_config_t *config, workload_simulation_t *ws, io_engine_t *io_engine) {
     io_engine->pre_close_teardown();
-    int res = close(io_engine->fd);
-    check("Could not close the file", res == -1);
-    
-    if(ws->output_fd != -1) {
-        res = close(ws->output_fd);
-        check("Could not close the output file", res == -1);
+    int res;
+    if(io_engine->file_pool) {
+        io_engine->file_opens = io_engine->file_pool->opens;
+        delete io_engine->file_pool;
+        io_engine->file_pool = NULL;
+    } else {
+        res = close(io_engine->fd);
+        check("Could not close the file", res == -1);
     }
 }
 
+long long timeval_to_usecs(timeval tv) {
+    return (long long)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
 void* simulation_worker(void *arg) {
     io_engine_t *io_engine = (io_engine_t*)arg;
+    perf_counters_t *perf_counters = NULL;
+    if(io_engine->config->perf) {
+        perf_counters = new perf_counters_t();
+        io_engine->perf_user_only = perf_counters->user_only;
+    }
+    rusage usage_start, usage_end;
+    check("Could not get thread resource usage",
+          getrusage(RUSAGE_THREAD, &usage_start) != 0);
+    if(perf_counters)
+        perf_counters->start();
     io_engine->run_benchmark();
+    if(perf_counters)
+        perf_counters->stop(io_engine->perf_values);
+    check("Could not get thread resource usage",
+          getrusage(RUSAGE_THREAD, &usage_end) != 0);
+    io_engine->major_faults = usage_end.ru_majflt - usage_start.ru_majflt;
+    io_engine->minor_faults = usage_end.ru_minflt - usage_start.ru_minflt;
+    io_engine->user_usecs = timeval_to_usecs(usage_end.ru_utime) - timeval_to_usecs(usage_start.ru_utime);
+    io_engine->system_usecs = timeval_to_usecs(usage_end.ru_stime) - timeval_to_usecs(usage_start.ru_stime);
+    io_engine->voluntary_switches = usage_end.ru_nvcsw - usage_start.ru_nvcsw;
+    io_engine->involuntary_switches = usage_end.ru_nivcsw - usage_start.ru_nivcsw;
+    if(perf_counters)
+        delete perf_counters;
     return NULL;
 }
 
-void print_stats(ticks_t start_time, ticks_t end_time, long long ops, workload_config_t *config,
+double calibrate_harness(workload_config_t *config) {
+    // Run the workload's threads through the full benchmark loop and
+    // stats path, minus the IO
+    workload_config_t null_config = *config;
+    null_config.io_type = iot_null;
+    null_config.duration_unit = dut_time;
+
+    int is_done = 0;
+    pthread_mutex_t latency_mutex;
+    pthread_mutex_init(&latency_mutex, NULL);
+    stream_stat_t stream_stat(LATENCY_BUCKETS, LATENCY_BUCKET_SIZE_EXP);
+    stream_stat_t flush_stat(LATENCY_BUCKETS, LATENCY_BUCKET_SIZE_EXP);
+    if(config->percentile_mark_count > 0) {
+        std::vector<double> marks(config->percentile_marks,
+                                  config->percentile_marks + config->percentile_mark_count);
+        stream_stat.set_percentile_marks(marks);
+        flush_stat.set_percentile_marks(marks);
+    }
+    latency_buffer_t *latencies = NULL;
+    if(config->sample_step == 0)
+        latencies = new latency_buffer_t(config->latency_capacity, config->latency_capture);
+
+    std::vector<io_engine_t*> engines;
+    std::vector<pthread_t> threads;
+    for(int i = 0; i < config->threads; i++) {
+        io_engine_t *io_engine = make_engine(iot_null, latencies, &stream_stat, &latency_mutex);
+        io_engine->config = &null_config;
+        io_engine->is_done = &is_done;
+        io_engine->flush_stat = &flush_stat;
+        io_engine->thread_id = i;
+        pthread_t thread;
+        check("Error creating thread",
+              pthread_create(&thread, NULL, &simulation_worker, (void*)io_engine) != 0);
+        engines.push_back(io_engine);
+        threads.push_back(thread);
+    }
+
+    usleep(CALIBRATION_MS * 1000);
+    is_done = 1;
+    // Time the window the engines actually spent issuing ops, since a
+    // bounded sequential range can run out well before the sleep ends
+    long long ops = 0;
+    ticks_t start_time = 0, end_time = 0;
+    for(int i = 0; i < config->threads; i++) {
+        check("Error joining thread", pthread_join(threads[i], NULL) != 0);
+        io_engine_t *engine = engines[i];
+        ops += engine->ops;
+        if(engine->first_op_start != 0 &&
+           (start_time == 0 || engine->first_op_start < start_time))
+            start_time = engine->first_op_start;
+        if(engine->last_op_end > end_time)
+            end_time = engine->last_op_end;
+        delete engine;
+    }
+
+    if(latencies)
+        delete latencies;
+    pthread_mutex_destroy(&latency_mutex);
+    if(start_time == 0 || end_time <= start_time)
+        return 0;
+    return ops / ticks_to_secs(end_time - start_time);
+}
+
+void print_stats(ticks_t start_time, ticks_t end_time, long long ops, double op_bytes, workload_config_t *config,
                  long long min_ops_per_sec, long long max_ops_per_sec, float agg_std_dev,
                  unsigned long long sum_latency, unsigned long long min_latency,
                  unsigned long long max_latency) {
     if(config->duration_unit == dut_interactive)
         return;
     float total_secs = ticks_to_secs(end_time - start_time);
+    double mb_per_sec = ((double)ops * op_bytes / 1024 / 1024) / total_secs;
     float _sum_latency;
     float _min_latency;
     float _max_latency;
@@ -85,13 +178,13 @@ void print_stats(ticks_t start_time, ticks_t end_time, long long ops, workload_c
         if(config->sample_step == 0) {
             printf("%.2f %.2f %.2f %.2f %.2f\n",
                    ticks_to_us(sum_latency) / ops,                                     // mean latency (in microseconds)
-                   ((double)ops * config->block_size / 1024 / 1024) / total_secs,      // MB/sec
+                   mb_per_sec,                                                         // MB/sec
                    ticks_to_us(min_latency), ticks_to_us(max_latency),                 // min latency, max latency
                    ticks_to_us(agg_std_dev));                                          // deviation
         } else {
             printf("%d %.2f %llu %llu %d\n",
                    (int)((float)ops / total_secs),                                     // mean ops per sec
-                   ((double)ops * config->block_size / 1024 / 1024) / total_secs,      // MB/sec
+                   mb_per_sec,                                                         // MB/sec
                    min_ops_per_sec, max_ops_per_sec, (int)agg_std_dev);                // min ops/sec, max ops/sec, deviation
         }
     } else {
@@ -103,7 +196,7 @@ void print_stats(ticks_t start_time, ticks_t end_time, long long ops, workload_c
             else
                 printf("us");
             printf(" (%.2f MB/sec), min - %.2f, max - %.2f, stddev - %.2f (%.2f%%)\n",
-                   ((double)ops * config->block_size / 1024 / 1024) / total_secs,
+                   mb_per_sec,
                    _min_latency, _max_latency, _agg_std_dev,
                    _agg_std_dev / mean * 100.0f);
             printf("Mean ops/sec: %d\n", (int)((float)ops / total_secs));
@@ -111,7 +204,7 @@ void print_stats(ticks_t start_time, ticks_t end_time, long long ops, workload_c
             float mean = (float)ops / total_secs;
             printf("Ops/sec: mean - %d (%.2f MB/sec), min - %llu, max - %llu, stddev - %d (%.2f%%)\n",
                    (int)mean,
-                   ((double)ops * config->block_size / 1024 / 1024) / total_secs,
+                   mb_per_sec,
                    min_ops_per_sec, max_ops_per_sec, (int)agg_std_dev,
                    agg_std_dev / mean * 100.0f);
             float latency = 1000000.0f / mean;
@@ -125,18 +218,158 @@ void print_stats(ticks_t start_time, ticks_t end_time, long long ops, workload_c
     }
 }
 
-void print_latency_stats(workload_config_t *config, stat_data_t stat_data) {
+void print_latency_stats(workload_config_t *config, const char *title, stat_data_t stat_data) {
 	if(config->duration_unit == dut_interactive)
         	return;
 
-	printf("Latency statistics: mean - %.3f us, min - %.3f us, max - %.3f us | percentiles: ", 
-		stat_data.mean / 1000.0, ticks_to_us(stat_data.min_value), ticks_to_us(stat_data.max_value));	
+	printf("%s: mean - %.3f us, min - %.3f us, max - %.3f us | percentiles: ", 
+		title, stat_data.mean / 1000.0, ticks_to_us(stat_data.min_value), ticks_to_us(stat_data.max_value));	
 	for(std::map<double, ticks_t>::iterator it = stat_data.percentiles.begin(); it != stat_data.percentiles.end(); ++it) {
-		printf("%.1fth - %.1f us; ", it->first*100, ticks_to_us(it->second) );
+		printf("%gth - %.3f us; ", it->first*100, ticks_to_us(it->second) );
 	}
 	printf("\n");
 }
 
+void print_cpu_stats(workload_config_t *config, ticks_t start_time, ticks_t end_time,
+                     long long ops, cpu_stat_t *cpu_stat) {
+    if(config->silent || config->duration_unit == dut_interactive || ops == 0)
+        return;
+    float total_secs = ticks_to_secs(end_time - start_time);
+    printf("CPU: %.2f us/op (user - %.2f, system - %.2f), %.1f%% of a core, context switches - %.3f/op\n",
+           (double)(cpu_stat->user_usecs + cpu_stat->system_usecs) / ops,
+           (double)cpu_stat->user_usecs / ops, (double)cpu_stat->system_usecs / ops,
+           (cpu_stat->user_usecs + cpu_stat->system_usecs) / 10000.0 / total_secs,
+           (double)(cpu_stat->voluntary_switches + cpu_stat->involuntary_switches) / ops);
+
+    if(!config->perf)
+        return;
+    const char *counters[] = { "cycles", "instructions", "context switches", "page faults", "syscalls" };
+    printf("Perf counters:");
+    for(int i = 0; i < pfc_count; i++) {
+        if(cpu_stat->perf_values[i] == -1)
+            printf(" %s - n/a", counters[i]);
+        else
+            printf(" %s - %.2f/op", counters[i], (double)cpu_stat->perf_values[i] / ops);
+        if(i == pfc_instructions && cpu_stat->perf_values[pfc_cycles] > 0 && cpu_stat->perf_values[pfc_instructions] != -1)
+            printf(" (IPC %.2f)", (double)cpu_stat->perf_values[pfc_instructions] / cpu_stat->perf_values[pfc_cycles]);
+        printf(i < pfc_count - 1 ? "," : "\n");
+    }
+    if(cpu_stat->perf_user_only)
+        printf("Cycles and instructions are counted in user space only (see perf_event_paranoid)\n");
+}
+
+void print_harness_stats(workload_config_t *config, ticks_t start_time, ticks_t end_time,
+                         long long ops, double harness_ops_per_sec) {
+    if(config->silent || config->duration_unit == dut_interactive || harness_ops_per_sec == 0)
+        return;
+    double ops_per_sec = ops / ticks_to_secs(end_time - start_time);
+    double share = ops_per_sec / harness_ops_per_sec * 100.0;
+    printf("Harness ceiling: %.0f ops/sec (%.1f ns/op per thread), this run reached %.1f%% of it\n",
+           harness_ops_per_sec, config->threads * 1000000000.0 / harness_ops_per_sec, share);
+    if(share > 50.0)
+        printf("Warning: rebench's own overhead is a large part of each op, the result measures the harness as much as the IO\n");
+}
+
+void print_warmup_stats(workload_config_t *config, long long warmup_ops, ticks_t warmup_ticks) {
+    if(config->silent || config->warmup == 0)
+        return;
+    printf("Warmup: %lld ops in %.2f secs, excluded from the results\n", warmup_ops, ticks_to_secs(warmup_ticks));
+}
+
+void print_steady_state_stats(workload_config_t *config, int steady_state, ticks_t time_to_steady_state) {
+    if(config->silent || config->steady_state_rounds == 0)
+        return;
+    if(steady_state)
+        printf("Steady state: reached after %.2f secs, results cover the last %d sample steps\n",
+               ticks_to_secs(time_to_steady_state), config->steady_state_rounds);
+    else
+        printf("Steady state: not reached, results cover the whole run\n");
+}
+
+void print_device_stats(workload_config_t *config, device_stats_t *device_stats,
+                        disk_counters_t *start, disk_counters_t *end) {
+    if(config->silent || config->duration_unit == dut_interactive || device_stats == NULL)
+        return;
+    disk_rates_t rates = device_stats_t::compute_rates(*start, *end);
+    printf("Device [%s]: reads - %.1f/sec (%.2f MB/sec, %.1f merges/sec, await %.3f ms), "
+           "writes - %.1f/sec (%.2f MB/sec, %.1f merges/sec, await %.3f ms), "
+           "avg queue size - %.2f, utilization - %.1f%%\n",
+           device_stats->get_name(),
+           rates.reads_per_sec, rates.read_mb_per_sec, rates.read_merges_per_sec, rates.read_await_ms,
+           rates.writes_per_sec, rates.write_mb_per_sec, rates.write_merges_per_sec, rates.write_await_ms,
+           rates.avg_queue_size, rates.utilization);
+}
+
+void print_fault_stats(workload_config_t *config, long major_faults, long minor_faults) {
+    if(config->silent || config->duration_unit == dut_interactive)
+        return;
+    printf("Page faults: major - %ld, minor - %ld\n", major_faults, minor_faults);
+}
+
+void print_file_set_stats(workload_config_t *config, file_set_t *file_set, long opens, long long ops) {
+    if(config->silent || file_set == NULL)
+        return;
+    printf("Files: %d in the set, %ld opens (%.3f/op)\n",
+           file_set->size(), opens, ops == 0 ? 0 : (double)opens / ops);
+}
+
+void print_object_stats(workload_config_t *config, double op_bytes) {
+    if(config->silent || config->io_type != iot_object)
+        return;
+    printf("Objects: mean size - %.2f KB\n", op_bytes / 1024);
+}
+
+void print_trace_stats(workload_config_t *config, trace_writer_t *trace_writer) {
+    if(config->silent || trace_writer == NULL)
+        return;
+    printf("Trace: %lld ops recorded, %lld dropped\n",
+           trace_writer->get_written(), trace_writer->get_dropped());
+}
+
+void print_capture_stats(workload_config_t *config, latency_buffer_t *latencies) {
+    if(config->silent || latencies == NULL || latencies->get_sampled_out() == 0)
+        return;
+    printf("Latency capture: %lld of %lld ops recorded, %lld %s\n",
+           latencies->get_seen() - latencies->get_sampled_out(), latencies->get_seen(),
+           latencies->get_sampled_out(),
+           config->latency_capture == lct_ring ? "overwritten" : "sampled out");
+}
+
+void print_trim_stats(workload_config_t *config, ticks_t start_time, ticks_t end_time,
+                      long long ops, long trim_commands) {
+    if(config->silent || config->duration_unit == dut_interactive || trim_commands == 0)
+        return;
+    double total_mb = (double)ops * config->block_size / 1024 / 1024;
+    printf("Trimmed: %.2f MB (%.2f MB/sec) in %ld commands, %.2f KB per command\n",
+           total_mb, total_mb / ticks_to_secs(end_time - start_time), trim_commands,
+           total_mb * 1024 / trim_commands);
+}
+
+cpu_stat_t compute_cpu_stats(workload_simulation_t *ws) {
+    cpu_stat_t cpu_stat;
+    bzero(&cpu_stat, sizeof(cpu_stat));
+    for(int j = 0; j < pfc_count; j++)
+        cpu_stat.perf_values[j] = ws->engines.empty() ? -1 : 0;
+    for(int i = 0; i < ws->engines.size(); i++) {
+        io_engine_t *engine = ws->engines[i];
+        cpu_stat.user_usecs += engine->user_usecs;
+        cpu_stat.system_usecs += engine->system_usecs;
+        cpu_stat.major_faults += engine->major_faults;
+        cpu_stat.minor_faults += engine->minor_faults;
+        cpu_stat.voluntary_switches += engine->voluntary_switches;
+        cpu_stat.involuntary_switches += engine->involuntary_switches;
+        cpu_stat.perf_user_only |= engine->perf_user_only;
+        // A counter missing on any thread is missing for the workload
+        for(int j = 0; j < pfc_count; j++) {
+            if(engine->perf_values[j] == -1)
+                cpu_stat.perf_values[j] = -1;
+            else if(cpu_stat.perf_values[j] != -1)
+                cpu_stat.perf_values[j] += engine->perf_values[j];
+        }
+    }
+    return cpu_stat;
+}
+
 long long compute_total_ops(workload_simulation_t *ws) {
     long long ops = 0;
     for(int i = 0; i < ws->config.threads; i++) {
@@ -145,4 +378,32 @@ long long compute_total_ops(workload_simulation_t *ws) {
     return ops;
 }
 
+double compute_op_bytes(workload_simulation_t *ws) {
+    if(ws->config.io_type == iot_meta)
+        return 0;
+    if(ws->config.pattern != pat_none) {
+        // Every step but syncs moves a block
+        pattern_step_t steps[MAX_PATTERN_STEPS];
+        int count = get_pattern_steps(ws->config.pattern, steps);
+        int blocks = 0;
+        for(int i = 0; i < count; i++)
+            blocks += steps[i] != pst_sync;
+        return (double)blocks * ws->config.block_size;
+    }
+    if(ws->config.io_type != iot_object)
+        return ws->config.block_size;
+    // Sizes vary, warmup included
+    long long bytes = 0;
+    for(int i = 0; i < ws->engines.size(); i++)
+        bytes += ws->engines[i]->object_bytes;
+    return ws->total_ops == 0 ? 0 : (double)bytes / ws->total_ops;
+}
+
+long compute_file_opens(workload_simulation_t *ws) {
+    long opens = 0;
+    for(int i = 0; i < ws->engines.size(); i++)
+        opens += ws->engines[i]->file_opens;
+    return opens;
+}
+
 
@@ -3,26 +3,52 @@
 #define __SIMULATION_HPP__
 
 #include <vector>
+#include <deque>
 #include <pthread.h>
 #include "utils.hpp"
 #include "stream_stat.hpp"
+#include "trace.hpp"
+#include "latency_buffer.hpp"
+#include "perf_counters.hpp"
+#include "device_stats.hpp"
+#include "file_set.hpp"
+
+// Throughput of a single sample step
+struct interval_stat_t {
+    ticks_t time; // since the start of the workload
+    int ops_per_sec;
+    long long ops; // measured so far
+    int phase; // index into the config phases, 0 without phases
+};
 
 // Describes each workload simulation
 class io_engine_t;
 struct workload_simulation_t {
     workload_simulation_t()
         : min_ops_per_sec(1000000), max_ops_per_sec(0), last_ops_so_far(0), output_fd(-1),
-          sum_latency(0), min_latency(1000000000L), max_latency(0)
+          sum_latency(0), min_latency(1000000000L), max_latency(0), harness_ops_per_sec(0),
+          is_warm(0), warmup_ops(0), warmup_ticks(0), steady_state(0), steady_ops(0),
+          metrics_slot(0), phase(0), output_tag(NULL), output_append(0)
         {}
     
     std::vector<io_engine_t*> engines;
     std::vector<pthread_t> threads;
     workload_config_t config;
     int is_done;
+    int is_joined;
     ticks_t start_time, end_time;
     long long ops;
-    std::vector<ticks_t> latencies;
+    latency_buffer_t *latencies;
     stream_stat_t *stream_stat;
+    stream_stat_t *flush_stat;
+    // Latencies of every metadata op, all NULL unless the engine is 'meta'
+    stream_stat_t *meta_stats[mop_count];
+    // Latencies of every kind of pattern step, all NULL without a pattern
+    stream_stat_t *step_stats[pst_count];
+    trace_writer_t *trace_writer;
+    device_stats_t *device_stats;
+    file_set_t *file_set; // NULL unless DEVICE is a file set
+    disk_counters_t device_start, device_last, device_end;
     pthread_mutex_t latency_mutex;
 
     void *mmap;
@@ -34,24 +60,89 @@ struct workload_simulation_t {
     // stats info
     long long min_ops_per_sec, max_ops_per_sec;
     unsigned long long last_ops_so_far;
+    std::vector<interval_stat_t> intervals;
+
+    // Ops/sec of the same workload on the null engine, 0 if not calibrated
+    double harness_ops_per_sec;
+
+    // Warmup, left out of the stats. The run starts measuring (start_time
+    // moves) once is_warm is set.
+    int is_warm;
+    long long warmup_ops;
+    ticks_t warmup_ticks;
+
+    // Steady state detection, with the latency histograms of the last
+    // rounds. Once steady, the results cover the window of the last rounds.
+    std::deque<std::vector<unsigned char> > round_histograms;
+    int steady_state;
+    ticks_t steady_start_time, steady_end_time;
+    long long steady_ops;
+
+    // Whole run, warmup included
+    ticks_t run_start_time, run_end_time;
+    long long total_ops;
+
+    // Index of the workload on the metrics endpoint
+    int metrics_slot;
+
+    // Current phase, moved on by the monitor and read by the engines
+    volatile int phase;
     
     std_dev_t std_dev;
     int output_fd;
+    int histogram_fd;
+    // Ends every --output line of a preconditioning step, NULL otherwise
+    const char *output_tag;
+    // Set once preconditioning wrote to --output, the run appends to it
+    int output_append;
 };
 typedef std::vector<workload_simulation_t*> wsp_vector;
 
+// CPU usage summed over the threads of a workload
+struct cpu_stat_t {
+    long long user_usecs;
+    long long system_usecs;
+    long major_faults;
+    long minor_faults;
+    long voluntary_switches;
+    long involuntary_switches;
+    long long perf_values[pfc_count]; // -1 if unavailable on any thread
+    int perf_user_only;
+};
+
 class io_engine_t;
 void setup_io(workload_config_t *config, workload_simulation_t *ws, io_engine_t *io_engine);
 void cleanup_io(workload_config_t *config, workload_simulation_t *ws, io_engine_t *io_engine);
 
 void* simulation_worker(void *arg);
+double calibrate_harness(workload_config_t *config);
 
-void print_stats(ticks_t start_time, ticks_t end_time, long long ops, workload_config_t *config,
+void print_stats(ticks_t start_time, ticks_t end_time, long long ops, double op_bytes, workload_config_t *config,
                  long long min_ops_per_sec, long long max_ops_per_sec, float agg_std_dev,
                  unsigned long long sum_latency, unsigned long long min_latency,
                  unsigned long long max_latency);
-void print_latency_stats(workload_config_t *config, stat_data_t stat_data);
+void print_latency_stats(workload_config_t *config, const char *title, stat_data_t stat_data);
+void print_cpu_stats(workload_config_t *config, ticks_t start_time, ticks_t end_time,
+                     long long ops, cpu_stat_t *cpu_stat);
+void print_harness_stats(workload_config_t *config, ticks_t start_time, ticks_t end_time,
+                         long long ops, double harness_ops_per_sec);
+void print_warmup_stats(workload_config_t *config, long long warmup_ops, ticks_t warmup_ticks);
+void print_steady_state_stats(workload_config_t *config, int steady_state, ticks_t time_to_steady_state);
+void print_device_stats(workload_config_t *config, device_stats_t *device_stats,
+                        disk_counters_t *start, disk_counters_t *end);
+void print_fault_stats(workload_config_t *config, long major_faults, long minor_faults);
+void print_file_set_stats(workload_config_t *config, file_set_t *file_set, long opens, long long ops);
+void print_object_stats(workload_config_t *config, double op_bytes);
+void print_trace_stats(workload_config_t *config, trace_writer_t *trace_writer);
+void print_capture_stats(workload_config_t *config, latency_buffer_t *latencies);
+void print_trim_stats(workload_config_t *config, ticks_t start_time, ticks_t end_time,
+                      long long ops, long trim_commands);
 long long compute_total_ops(workload_simulation_t *ws);
+cpu_stat_t compute_cpu_stats(workload_simulation_t *ws);
+long compute_file_opens(workload_simulation_t *ws);
+// Mean bytes moved by an op of the workload, counting every block of the
+// steps of a pattern and nothing for metadata ops
+double compute_op_bytes(workload_simulation_t *ws);
 
 #endif // __SIMULATION_HPP__
 
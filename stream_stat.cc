@@ -2,6 +2,8 @@
 #include <math.h>
 #include <stdlib.h>
 #include <vector>
+#include <string>
+#include <algorithm>
 #include <limits>
 #include <string.h>
 #include <stdio.h>
@@ -17,6 +19,9 @@ stream_stat_t::stream_stat_t(int _buckets, int _bucket_size_exp) : buckets(_buck
 	default_percentile_marks.push_back(0.95);
 	default_percentile_marks.push_back(0.99);
 	default_percentile_marks.push_back(0.995);
+	default_percentile_marks.push_back(0.999);
+	default_percentile_marks.push_back(0.9999);
+	default_percentile_marks.push_back(0.99999);
 
 	global_stat = new stat_counters_t();
 	init_stat_counters(global_stat);
@@ -46,16 +51,21 @@ void stream_stat_t::destroy_stat_counters(stat_counters_t *stat_counters) {
 }
 
 void stream_stat_t::add(ticks_t value) {
-	int b = ceil(log10(double(value / bucket_size)));		
-	if(b < buckets) {
-		int compressed_value = value;
-		if(b != 0) {
-			compressed_value = floor( double(value) / pow(10, b) + 0.5);
-		}		
-
-		add(active_stat, b, compressed_value, value);
-		add(global_stat, b, compressed_value, value);
+	// Bucket b holds values in [bucket_size * 10^(b-1), bucket_size * 10^b)
+	// truncated to bucket_size_exp significant digits (bucket 0 holds
+	// values below bucket_size exactly). Values past the last bucket are
+	// counted in its last slot.
+	int b = 0;
+	ticks_t compressed_value = value;
+	while(compressed_value >= bucket_size && b < buckets - 1) {
+		compressed_value /= 10;
+		b++;
 	}
+	if(compressed_value >= bucket_size)
+		compressed_value = bucket_size - 1;
+
+	add(active_stat, b, compressed_value, value);
+	add(global_stat, b, compressed_value, value);
 }
 
 inline void stream_stat_t::add(stat_counters_t *stat_counters, int b, int compressed_value, ticks_t value) {
@@ -67,6 +77,10 @@ inline void stream_stat_t::add(stat_counters_t *stat_counters, int b, int compre
 	stat_counters->min_value = std::min(stat_counters->min_value, value);
 }
 
+void stream_stat_t::set_percentile_marks(const std::vector<double> &percentile_marks) {
+	default_percentile_marks = percentile_marks;
+}
+
 void stream_stat_t::snapshot_and_reset() {
 	destroy_stat_counters(snapshot_stat);	
 	snapshot_stat = active_stat;
@@ -77,6 +91,12 @@ void stream_stat_t::snapshot_and_reset() {
 	active_stat = active_new_stat;
 }
 
+void stream_stat_t::reset_global() {
+	destroy_stat_counters(global_stat);
+	global_stat = new stat_counters_t();
+	init_stat_counters(global_stat);
+}
+
 stat_data_t stream_stat_t::get_snapshot_stat() {
 	return get_snapshot_stat(default_percentile_marks);
 }
@@ -98,19 +118,27 @@ stat_data_t stream_stat_t::get_stat(stat_counters_t *stat_counters, std::vector<
 	
 	std::map<double, ticks_t> percentiles;
 	long total = 0;	
-	for(int i = 0; total < stat_counters->count && i < buckets*bucket_size && mark_pointer < percentile_marks.size(); i++) {	
-		if(total >= percentile_marks[mark_pointer] * stat_counters->count) {
+	for(int i = 0; i < buckets*bucket_size && mark_pointer < percentile_marks.size(); i++) {	
+		total += stat_counters->histogram[i];
+		// The mark is reached by the slot holding its rank
+		while(mark_pointer < percentile_marks.size()) {
+			long rank = std::max(1.0, ceil(percentile_marks[mark_pointer] * stat_counters->count - 1e-6));
+			if(total < rank)
+				break;
 			int b = i / bucket_size;
-			ticks_t latency = (i - b*bucket_size) * pow(10, b);
-			//printf(">>> total=%d b=%d i=%d latency=%d\n", total, b, i, latency);
+			ticks_t scale = pow(10, b);
+			// Report the middle of the slot, within the range actually seen
+			ticks_t latency = (i - b*bucket_size) * scale + scale / 2;
+			latency = std::max(stat_counters->min_value, std::min(stat_counters->max_value, latency));
+			if(rank == stat_counters->count)
+				latency = stat_counters->max_value;
 			percentiles.insert( std::pair<double, ticks_t>(percentile_marks[mark_pointer], latency) );
 
 			mark_pointer++;
 		}
-		total += stat_counters->histogram[i];
 	}
 	while(mark_pointer < percentile_marks.size()) {
-		percentiles.insert( std::pair<double, ticks_t>(percentile_marks[mark_pointer], stat_counters->max_value));
+		percentiles.insert( std::pair<double, ticks_t>(percentile_marks[mark_pointer], stat_counters->count > 0 ? stat_counters->max_value : 0));
 		mark_pointer++;
 	}
 
@@ -123,3 +151,126 @@ stat_data_t stream_stat_t::get_stat(stat_counters_t *stat_counters, std::vector<
 	
 	return result;	
 }
+
+int parse_percentile_marks(const char *str, double *marks, int max_marks) {
+	std::vector<double> parsed;
+	const char *pos = str;
+	while(*pos) {
+		const char *end = strchr(pos, ',');
+		if(end == NULL)
+			end = pos + strlen(pos);
+		std::string mark(pos, end - pos);
+		double value;
+		char *parse_end;
+		if(mark == "max") {
+			value = 100;
+		} else {
+			value = strtod(mark.c_str(), &parse_end);
+			if(mark.empty() || *parse_end != 0 || value <= 0 || value > 100)
+				return -1;
+		}
+		parsed.push_back(value / 100.0);
+		pos = *end ? end + 1 : end;
+	}
+	std::sort(parsed.begin(), parsed.end());
+	parsed.erase(std::unique(parsed.begin(), parsed.end()), parsed.end());
+	if(parsed.empty() || parsed.size() > max_marks)
+		return -1;
+	std::copy(parsed.begin(), parsed.end(), marks);
+	return parsed.size();
+}
+
+static void put_varint(std::vector<unsigned char> &out, unsigned long long value) {
+	while(value >= 0x80) {
+		out.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((unsigned char)value);
+}
+
+static int get_varint(const unsigned char *data, int size, int *pos, unsigned long long *value) {
+	*value = 0;
+	for(int shift = 0; *pos < size && shift < 64; shift += 7) {
+		unsigned char byte = data[(*pos)++];
+		*value |= (unsigned long long)(byte & 0x7f) << shift;
+		if(!(byte & 0x80))
+			return 1;
+	}
+	return 0;
+}
+
+void stream_stat_t::serialize_snapshot(std::vector<unsigned char> &out) {
+	serialize(snapshot_stat, out);
+}
+
+void stream_stat_t::serialize_global(std::vector<unsigned char> &out) {
+	serialize(global_stat, out);
+}
+
+// Layout: buckets, bucket_size_exp, count, sum (as double bits), min,
+// max, number of non-empty buckets, then (index gap, count) pairs, all
+// varint encoded.
+void stream_stat_t::serialize(stat_counters_t *stat_counters, std::vector<unsigned char> &out) {
+	put_varint(out, buckets);
+	put_varint(out, bucket_size_exp);
+	put_varint(out, stat_counters->count);
+	unsigned long long sum_bits;
+	memcpy(&sum_bits, &stat_counters->sum_values, sizeof(sum_bits));
+	put_varint(out, sum_bits);
+	put_varint(out, stat_counters->min_value);
+	put_varint(out, stat_counters->max_value);
+
+	int non_empty = 0;
+	for(int i = 0; i < buckets * bucket_size; i++) {
+		if(stat_counters->histogram[i] != 0)
+			non_empty++;
+	}
+	put_varint(out, non_empty);
+
+	int last = 0;
+	for(int i = 0; i < buckets * bucket_size; i++) {
+		if(stat_counters->histogram[i] != 0) {
+			put_varint(out, i - last);
+			put_varint(out, stat_counters->histogram[i]);
+			last = i;
+		}
+	}
+}
+
+int stream_stat_t::merge_into_global(const unsigned char *data, int size) {
+	int pos = 0;
+	unsigned long long _buckets, _bucket_size_exp, count, sum_bits, min_value, max_value, non_empty;
+	if(!get_varint(data, size, &pos, &_buckets) ||
+	   !get_varint(data, size, &pos, &_bucket_size_exp) ||
+	   !get_varint(data, size, &pos, &count) ||
+	   !get_varint(data, size, &pos, &sum_bits) ||
+	   !get_varint(data, size, &pos, &min_value) ||
+	   !get_varint(data, size, &pos, &max_value) ||
+	   !get_varint(data, size, &pos, &non_empty))
+		return -1;
+	if(_buckets != buckets || _bucket_size_exp != bucket_size_exp)
+		return -1;
+
+	// The gaps come from the file, check them before they can run the
+	// index past the histogram
+	unsigned long long index = 0, slots = buckets * bucket_size;
+	for(unsigned long long i = 0; i < non_empty; i++) {
+		unsigned long long gap, bucket_count;
+		if(!get_varint(data, size, &pos, &gap) ||
+		   !get_varint(data, size, &pos, &bucket_count))
+			return -1;
+		check("Histogram bucket out of range", gap >= slots - index);
+		index += gap;
+		global_stat->histogram[index] += bucket_count;
+	}
+
+	double sum;
+	memcpy(&sum, &sum_bits, sizeof(sum));
+	global_stat->count += count;
+	global_stat->sum_values += sum;
+	if(count > 0) {
+		global_stat->min_value = std::min(global_stat->min_value, (ticks_t)min_value);
+		global_stat->max_value = std::max(global_stat->max_value, (ticks_t)max_value);
+	}
+	return pos;
+}
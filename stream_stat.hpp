@@ -5,6 +5,13 @@
 #include <vector>
 #include <map>
 
+// Histogram layout used for latencies: values below 10^4 nanoseconds
+// are kept exactly, larger ones with four significant digits (a
+// relative error of at most 0.05%, as percentiles report the middle of
+// a slot), up to 10^15 nanoseconds.
+#define LATENCY_BUCKETS 12
+#define LATENCY_BUCKET_SIZE_EXP 4
+
 struct stat_counters_t {
 	long *histogram;
 
@@ -35,7 +42,19 @@ public:
 	stat_data_t get_snapshot_stat();
 	stat_data_t get_snapshot_stat(std::vector<double> &percentile_marks);
 
+	// Marks used when none are passed, must be sorted
+	void set_percentile_marks(const std::vector<double> &percentile_marks);
+
 	void snapshot_and_reset();
+	// Forgets everything added so far to the global stat
+	void reset_global();
+
+	// Compact encoding of the counters (varint encoded non-empty buckets)
+	void serialize_snapshot(std::vector<unsigned char> &out);
+	void serialize_global(std::vector<unsigned char> &out);
+	// Adds serialized counters to the global stat, returns the number of
+	// bytes consumed or -1 if the data doesn't match this histogram layout
+	int merge_into_global(const unsigned char *data, int size);
 	
 private:
 
@@ -53,6 +72,12 @@ private:
 
 	stat_data_t get_stat(stat_counters_t *stat_counters, std::vector<double> &percentile_marks);
 	void add(stat_counters_t *stat_counters, int b, int compressed_value, ticks_t value);
+	void serialize(stat_counters_t *stat_counters, std::vector<unsigned char> &out);
 };
 
+// Parses a comma separated list of percentiles (e.g. "50,99.9,max") into
+// sorted fractions. Returns the number of marks or -1 if the list is
+// invalid or longer than max_marks.
+int parse_percentile_marks(const char *str, double *marks, int max_marks);
+
 #endif // __STREAM_STAT_HPP__
@@ -0,0 +1,179 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "trace.hpp"
+
+/**
+ * Trace ring
+ **/
+trace_ring_t::trace_ring_t()
+    : dropped(0), head(0), tail(0)
+{
+    records = (trace_record_t*)malloc(sizeof(trace_record_t) * TRACE_RING_SIZE);
+    check("Error allocating memory", records == NULL);
+}
+
+trace_ring_t::~trace_ring_t() {
+    free(records);
+}
+
+void trace_ring_t::push(const trace_record_t &record) {
+    unsigned long long _tail = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    if(head - _tail >= TRACE_RING_SIZE) {
+        dropped++;
+        return;
+    }
+    records[head & (TRACE_RING_SIZE - 1)] = record;
+    __atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+}
+
+int trace_ring_t::pop(trace_record_t *out, int max_count) {
+    unsigned long long _head = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    int count = 0;
+    while(tail + count < _head && count < max_count) {
+        out[count] = records[(tail + count) & (TRACE_RING_SIZE - 1)];
+        count++;
+    }
+    __atomic_store_n(&tail, tail + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+/**
+ * Trace writer
+ **/
+trace_writer_t::trace_writer_t(const char *file_name, int _rings)
+    : buffer_count(0), written(0), is_done(0)
+{
+    for(int i = 0; i < _rings; i++)
+        rings.push_back(new trace_ring_t());
+
+    buffer = (trace_record_t*)malloc(sizeof(trace_record_t) * TRACE_WRITE_BUFFER_SIZE);
+    check("Error allocating memory", buffer == NULL);
+
+    fd = open(file_name, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+    check("Error opening the trace file", fd == -1);
+
+    trace_header_t header;
+    bzero(&header, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.record_size = sizeof(trace_record_t);
+    int res = write(fd, &header, sizeof(header));
+    check("Could not write the trace header", res != sizeof(header));
+}
+
+trace_writer_t::~trace_writer_t() {
+    for(int i = 0; i < rings.size(); i++)
+        delete rings[i];
+    free(buffer);
+}
+
+void trace_writer_t::start() {
+    check("Error creating trace writer thread",
+          pthread_create(&thread, NULL, &writer_worker, (void*)this) != 0);
+}
+
+void trace_writer_t::stop() {
+    __atomic_store_n(&is_done, 1, __ATOMIC_RELEASE);
+    check("Error joining trace writer thread",
+          pthread_join(thread, NULL) != 0);
+
+    // The engines are done by now, pick up whatever is left
+    while(drain() > 0);
+    flush();
+
+    check("Could not close the trace file", close(fd) == -1);
+}
+
+trace_ring_t* trace_writer_t::get_ring(int i) {
+    return rings[i];
+}
+
+long long trace_writer_t::get_written() {
+    return written;
+}
+
+long long trace_writer_t::get_dropped() {
+    long long dropped = 0;
+    for(int i = 0; i < rings.size(); i++)
+        dropped += rings[i]->dropped;
+    return dropped;
+}
+
+void* trace_writer_t::writer_worker(void *arg) {
+    trace_writer_t *writer = (trace_writer_t*)arg;
+    while(!__atomic_load_n(&writer->is_done, __ATOMIC_ACQUIRE)) {
+        if(writer->drain() == 0)
+            usleep(1000);
+    }
+    return NULL;
+}
+
+int trace_writer_t::drain() {
+    int total = 0;
+    for(int i = 0; i < rings.size(); i++) {
+        int count;
+        do {
+            count = rings[i]->pop(buffer + buffer_count, TRACE_WRITE_BUFFER_SIZE - buffer_count);
+            buffer_count += count;
+            total += count;
+            if(buffer_count == TRACE_WRITE_BUFFER_SIZE)
+                flush();
+        } while(count > 0);
+    }
+    return total;
+}
+
+void trace_writer_t::flush() {
+    if(buffer_count == 0)
+        return;
+    ssize_t size = sizeof(trace_record_t) * buffer_count;
+    ssize_t res = write(fd, buffer, size);
+    check("Could not record trace data", res != size);
+    written += buffer_count;
+    buffer_count = 0;
+}
+
+/**
+ * Trace conversion
+ **/
+void print_trace(const char *file_name) {
+    int fd = open(file_name, O_RDONLY);
+    check("Error opening the trace file", fd == -1);
+
+    trace_header_t header;
+    int res = read(fd, &header, sizeof(header));
+    check("Could not read the trace header", res != sizeof(header));
+    check("Not a rebench trace file",
+          memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+          header.record_size != sizeof(trace_record_t));
+
+    const char *operations[] = { "read", "write", "trim", "sync" };
+    trace_record_t *records = (trace_record_t*)malloc(sizeof(trace_record_t) * TRACE_WRITE_BUFFER_SIZE);
+    check("Error allocating memory", records == NULL);
+
+    printf("start\tend\tlatency_us\toffset\tsize\toperation\tthread\n");
+    while(true) {
+        ssize_t size = read(fd, records, sizeof(trace_record_t) * TRACE_WRITE_BUFFER_SIZE);
+        check("Could not read trace data", size == -1);
+        if(size == 0)
+            break;
+        // A truncated trailing record is ignored
+        int count = size / sizeof(trace_record_t);
+        for(int i = 0; i < count; i++) {
+            trace_record_t *r = &records[i];
+            printf("%llu\t%llu\t%.2f\t%lld\t%u\t%s\t%u\n",
+                   (unsigned long long)r->start, (unsigned long long)r->end,
+                   ticks_to_us(r->end - r->start), (long long)r->offset, r->size,
+                   r->operation <= tro_sync ? operations[r->operation] : "unknown",
+                   r->thread);
+        }
+    }
+
+    free(records);
+    check("Could not close the trace file", close(fd) == -1);
+}
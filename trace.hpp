@@ -0,0 +1,86 @@
+#ifndef __TRACE_HPP__
+#define __TRACE_HPP__
+
+#include <vector>
+#include <pthread.h>
+#include <stdint.h>
+#include "utils.hpp"
+
+#define TRACE_MAGIC "RBTRACE1"
+#define TRACE_RING_SIZE (1 << 16) // records, must be a power of two
+#define TRACE_WRITE_BUFFER_SIZE (1 << 15) // records
+
+// Trace record operations past the operation_t ones
+enum trace_operation_t {
+    tro_sync = op_trim + 1 // a sync step of a pattern
+};
+
+// A single traced operation, as stored in the trace file
+struct trace_record_t {
+    uint64_t start;     // ticks
+    uint64_t end;       // ticks
+    int64_t offset;
+    uint32_t size;
+    uint16_t operation; // operation_t or trace_operation_t
+    uint16_t thread;
+};
+
+struct trace_header_t {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t reserved;
+};
+
+// Single producer single consumer ring. The engine thread pushes
+// records, the writer thread pops them. If the writer falls behind,
+// records are dropped (and counted) rather than stalling the engine.
+class trace_ring_t {
+public:
+    trace_ring_t();
+    ~trace_ring_t();
+
+    void push(const trace_record_t &record);
+
+    // Copies up to max_count records into out, returns the number copied
+    int pop(trace_record_t *out, int max_count);
+
+    long long dropped;
+
+private:
+    trace_record_t *records;
+    unsigned long long head; // written by the producer
+    unsigned long long tail; // written by the consumer
+};
+
+// Drains the rings of a workload into a trace file from a background thread
+class trace_writer_t {
+public:
+    trace_writer_t(const char *file_name, int rings);
+    ~trace_writer_t();
+
+    void start();
+    // Waits for the writer thread to drain the rings and closes the file
+    void stop();
+
+    trace_ring_t* get_ring(int i);
+    long long get_written();
+    long long get_dropped();
+
+private:
+    static void* writer_worker(void *arg);
+    int drain();
+    void flush();
+
+    std::vector<trace_ring_t*> rings;
+    trace_record_t *buffer;
+    int buffer_count;
+    long long written;
+    int fd;
+    int is_done;
+    pthread_t thread;
+};
+
+// Prints a trace file as text to stdout
+void print_trace(const char *file_name);
+
+#endif // __TRACE_HPP__
@@ -2,25 +2,111 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <math.h>
 #include <errno.h>
 #include <gsl/gsl_randist.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include "opts.hpp"
 #include "utils.hpp"
 
-ticks_t get_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define HAVE_TSC 1
+#endif
+
+#define TSC_SHIFT 32
+#define TSC_CALIBRATION_MS 50
+#define TSC_MAX_CALIBRATION_ERROR 0.0005
+
+static clock_source_t clock_source = cls_monotonic;
+static unsigned long long tsc_base, tsc_base_ns, tsc_mult;
+static double tsc_ghz = 0;
+
+static inline unsigned long long read_tsc() {
+#ifdef HAVE_TSC
+    // rdtscp waits for the preceding instructions to complete
+    unsigned int lo, hi, aux;
+    __asm__ __volatile__("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux));
+    return ((unsigned long long)hi << 32) | lo;
+#else
+    return 0;
+#endif
+}
+
+ticks_t get_monotonic_ticks() {
     timespec tv;
     clock_gettime(CLOCK_MONOTONIC, &tv);
     return secs_to_ticks(tv.tv_sec) + tv.tv_nsec;
 }
 
+ticks_t get_ticks() {
+    if(clock_source == cls_tsc)
+        return tsc_base_ns + (((unsigned __int128)(read_tsc() - tsc_base) * tsc_mult) >> TSC_SHIFT);
+    return get_monotonic_ticks();
+}
+
 long get_ticks_res() {
+    if(clock_source == cls_tsc)
+        return 1;
     timespec tv;
     clock_getres(CLOCK_MONOTONIC, &tv);
     return secs_to_ticks(tv.tv_sec) + tv.tv_nsec;
 }
 
+int tsc_available() {
+#ifdef HAVE_TSC
+    unsigned int eax, ebx, ecx, edx;
+    // rdtscp
+    if(!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 27)))
+        return 0;
+    // Invariant TSC: constant rate, doesn't stop in deep C-states
+    if(!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8)))
+        return 0;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+// Measures TSC cycles per nanosecond against CLOCK_MONOTONIC
+static double calibrate_tsc(unsigned long long *base, unsigned long long *base_ns) {
+    ticks_t start_ns = get_monotonic_ticks();
+    unsigned long long start = read_tsc();
+    usleep(TSC_CALIBRATION_MS * 1000);
+    ticks_t end_ns = get_monotonic_ticks();
+    unsigned long long end = read_tsc();
+    *base = end;
+    *base_ns = end_ns;
+    return (double)(end - start) / (end_ns - start_ns);
+}
+
+clock_source_t init_clock(clock_source_t source) {
+    clock_source = cls_monotonic;
+    if(source != cls_tsc || !tsc_available())
+        return clock_source;
+
+    // Two calibrations have to agree, otherwise the TSC isn't a
+    // reliable clock here (frequency scaling, migration, virtualization)
+    unsigned long long base, base_ns;
+    double first = calibrate_tsc(&base, &base_ns);
+    double second = calibrate_tsc(&base, &base_ns);
+    if(first <= 0 || fabs(first - second) / second > TSC_MAX_CALIBRATION_ERROR)
+        return clock_source;
+
+    tsc_ghz = second;
+    tsc_mult = (unsigned long long)((1ULL << TSC_SHIFT) / tsc_ghz);
+    tsc_base = base;
+    tsc_base_ns = base_ns;
+    clock_source = cls_tsc;
+    return clock_source;
+}
+
+double get_tsc_ghz() {
+    return tsc_ghz;
+}
+
 float ticks_to_secs(ticks_t ticks) {
     return ticks / 1000000000.0f;
 }
@@ -92,6 +178,10 @@ off64_t get_random(rnd_gen_t rnd_gen, rnd_dist_t dist, off64_t length, int sigma
     }
 }
 
+double get_random_fraction(rnd_gen_t rnd_gen) {
+    return gsl_rng_uniform((gsl_rng*)rnd_gen);
+}
+
 off64_t get_device_length(const char* device) {
     int fd;
     off64_t length;
@@ -108,6 +198,17 @@ off64_t get_device_length(const char* device) {
     return length;
 }
 
+int is_block_device(const char* device) {
+    struct stat64 st;
+    check("Error opening device", stat64(device, &st) != 0);
+    return S_ISBLK(st.st_mode);
+}
+
+int is_directory(const char* path) {
+    struct stat64 st;
+    return stat64(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
 void drop_caches(const char *device) {
     int res;
     int fd = open64(device, O_NOATIME | O_RDWR);
@@ -8,7 +8,16 @@ typedef unsigned long long ticks_t;
 
 long get_ticks_res(); // Returns ticks resolution in nanoseconds
 ticks_t get_ticks();
-ticks_t get_ticks();
+ticks_t get_monotonic_ticks();
+
+// Ticks are nanoseconds whatever the clock source. The TSC source reads
+// the invariant time stamp counter and scales it with a rate calibrated
+// against CLOCK_MONOTONIC. Returns the source actually used, which is
+// CLOCK_MONOTONIC if the TSC isn't invariant or doesn't calibrate
+// consistently.
+clock_source_t init_clock(clock_source_t source);
+int tsc_available();
+double get_tsc_ghz();
 float ticks_to_secs(ticks_t ticks);
 float ticks_to_ms(ticks_t ticks);
 float ticks_to_us(ticks_t ticks);
@@ -20,8 +29,12 @@ typedef void* rnd_gen_t;
 rnd_gen_t init_rnd_gen();
 void free_rnd_gen(rnd_gen_t rnd_gen);
 off64_t get_random(rnd_gen_t rnd_gen, rnd_dist_t dist, off64_t length, int sigma);
+// Uniform in [0, 1)
+double get_random_fraction(rnd_gen_t rnd_gen);
 
 off64_t get_device_length(const char* device);
+int is_block_device(const char* device);
+int is_directory(const char* path);
 
 void drop_caches(const char *device);
 
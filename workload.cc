@@ -14,9 +14,10 @@
 
 int is_done(off64_t offset, workload_config_t *config)
 {
-    if(config->workload == wl_rnd)
+    if(config->workload == wl_rnd || config->file_set)
         return 0;
-    if(config->workload == wl_seq && config->operation == op_write && config->direction == opd_forward)
+    if(config->workload == wl_seq && config->operation == op_write && config->direction == opd_forward &&
+       !config->fill)
         return 0;
     
     if(config->direction == opd_forward) {
@@ -28,9 +29,26 @@ int is_done(off64_t offset, workload_config_t *config)
     return 0;
 }
 
-off64_t prepare_offset(long long ops, rnd_gen_t rnd_gen, workload_config_t *config)
+static off64_t prepare_file_offset(rnd_gen_t rnd_gen, workload_config_t *config, file_entry_t *file)
+{
+    if(config->workload == wl_rnd)
+        return file->offset +
+            (get_random(rnd_gen, config->dist, file->length, config->sigma)
+             / config->stride * config->stride);
+
+    long long blocks = file->length / config->stride;
+    long long block = __sync_fetch_and_add(&file->cursor, 1) % blocks;
+    if(config->direction == opd_backward)
+        block = blocks - 1 - block;
+    return file->offset + block * config->stride;
+}
+
+off64_t prepare_offset(long long ops, rnd_gen_t rnd_gen, workload_config_t *config, file_entry_t *file)
 {
     off64_t offset = -1;
+
+    if(file != NULL)
+        return prepare_file_offset(rnd_gen, config, file);
             
     // Setup the offset
     if(config->workload == wl_rnd) {
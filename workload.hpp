@@ -2,9 +2,13 @@
 #ifndef __WORKLOAD_HPP__
 #define __WORKLOAD_HPP__
 
+#include "file_set.hpp"
+
 int is_done(off64_t offset, workload_config_t *config);
+// With a file, the offset falls into its range and sequential ops go
+// through it in turn, wrapping around at the end
 off64_t prepare_offset(long long ops, rnd_gen_t rnd_gen,
-                       workload_config_t *config);
+                       workload_config_t *config, file_entry_t *file = NULL);
 
 
 #endif // __WORKLOAD_HPP__